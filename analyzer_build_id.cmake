@@ -0,0 +1,20 @@
+# Writes analyzer_build_id.h with a hash of the analyzer sources. Results kept by on-disk, remote and journal caches
+# depend on the analyzer code, so any change of sources (not only of quirrel_static_analyzer.cpp) changes their keys,
+# and builds of the same sources on different machines share them.
+#   cmake -DSOURCE_DIR=<dir> -DOUTPUT=<file> -P analyzer_build_id.cmake
+
+file(GLOB BUILD_ID_SOURCES RELATIVE ${SOURCE_DIR}
+  ${SOURCE_DIR}/*.cpp ${SOURCE_DIR}/*.h ${SOURCE_DIR}/*.inl ${SOURCE_DIR}/quirrel/importParser/*.h)
+list(SORT BUILD_ID_SOURCES)
+
+set(BUILD_ID_CONTENT "")
+foreach(SOURCE_FILE ${BUILD_ID_SOURCES})
+  file(SHA1 ${SOURCE_DIR}/${SOURCE_FILE} SOURCE_HASH)
+  set(BUILD_ID_CONTENT "${BUILD_ID_CONTENT}${SOURCE_FILE} ${SOURCE_HASH}\n")
+endforeach()
+string(SHA1 BUILD_ID "${BUILD_ID_CONTENT}")
+
+# file is not touched if the id is the same, so nothing is rebuilt
+file(WRITE ${OUTPUT}.tmp "#pragma once\n\n#define ANALYZER_SOURCES_HASH \"${BUILD_ID}\"\n")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
@@ -0,0 +1,201 @@
+#include "analyzer_options.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+
+AnalyzerOptions::AnalyzerOptions()
+{
+  outputMode = OM_FULL;
+  printTokensToJson = false;
+  printAstToJson = false;
+  csqExe = "csq";
+  jobs = 1;
+  server = false;
+  watch = false;
+  batch = false;
+  verbose = false;
+  fileTimeBudgetMs = 0;
+  prefetchFiles = -1;
+  prefetchMemory = size_t(64) << 20;
+  shardIndex = 0;
+  shardCount = 0;
+  coordinatorPort = 0;
+  coordinatorAddress = "127.0.0.1";
+  workerTimeoutSec = 600;
+  workerPort = 0;
+}
+
+
+OutputMode str_to_output_mode(const char * str)
+{
+  if (!strcmp(str, "1-line"))
+    return OM_1_LINE;
+  else if (!strcmp(str, "2-lines"))
+    return OM_2_LINES;
+  else if (!strcmp(str, "full"))
+    return OM_FULL;
+
+  static bool errorShown = false;
+  if (!errorShown)
+    fprintf(out_stream, "WARNING: invalid output mode '%s', 'full' mode will be used.\n", str);
+  errorShown = true;
+
+  return OM_FULL;
+}
+
+
+static void suppress_warning(AnalyzerOptions & options, int int_id)
+{
+  if (int_id < 0 || int_id >= MAX_MESSAGE_ID)
+  {
+    options.argumentErrors.push_back(make_pair(30, string("Cannot suppress warning, invalid id: w") + to_string(int_id)));
+    return;
+  }
+
+  if (options.suppressedWarnings.test(int_id))
+  {
+    options.argumentErrors.push_back(make_pair(31, string("Warning is already suppressed: w") + to_string(int_id)));
+    return;
+  }
+
+  options.suppressedWarnings.set(int_id);
+}
+
+
+void parse_analyzer_options(int argc, char ** argv, AnalyzerOptions & options, set<int> & used_args)
+{
+  bool inverseWarnings = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char * arg = argv[i];
+    bool used = true;
+
+    {
+      // HACK: fix "duplucate-if-expression" -> "duplicate-if-expression", and support old config files
+      if (!strcmp("-duplucate-if-expression", arg))
+        arg = "-duplicate-if-expression";
+    }
+
+    if (!strncmp(arg, "--tokens-output-file:", 21))
+    {
+      options.printTokensToJson = true;
+      options.tokensFileName = arg + 21;
+    }
+    else if (!strncmp(arg, "--ast-output-file:", 18))
+    {
+      options.printAstToJson = true;
+      options.astFileName = arg + 18;
+    }
+    else if (!strcmp(arg, "--inverse-warnings"))
+      inverseWarnings = true;
+    else if (!strncmp(arg, "--csq-exe:", 10))
+      options.csqExe = arg + 10;
+    else if (!strncmp(arg, "--output-mode:", 14))
+      options.outputMode = str_to_output_mode(arg + 14);
+    else if (!strncmp(arg, "--jobs:", 7))
+    {
+      options.jobs = atoi(arg + 7);
+      if (options.jobs <= 0)
+        options.jobs = hardware_jobs_count();
+    }
+    else if (!strcmp(arg, "--server"))
+      options.server = true;
+    else if (!strncmp(arg, "--server:", 9))
+    {
+      options.server = true;
+      options.serverSocket = arg + 9;
+    }
+    else if (!strncmp(arg, "--cache-dir:", 12))
+      options.cacheDir = arg + 12;
+    else if (!strncmp(arg, "--cache-url:", 12))
+      options.cacheUrl = arg + 12;
+    else if (!strncmp(arg, "--coordinator:", 14))
+    {
+      const char * colon = strrchr(arg + 14, ':');
+      if (colon)
+        options.coordinatorAddress = string(arg + 14, colon);
+      options.coordinatorPort = atoi(colon ? colon + 1 : arg + 14);
+      if (options.coordinatorAddress.empty() || options.coordinatorPort <= 0 || options.coordinatorPort > 65535)
+        options.coordinatorPort = -1;
+    }
+    else if (!strncmp(arg, "--worker-timeout:", 17))
+    {
+      options.workerTimeoutSec = atoi(arg + 17);
+      if (options.workerTimeoutSec < 0)
+        options.workerTimeoutSec = 0;
+    }
+    else if (!strncmp(arg, "--worker:", 9))
+    {
+      const char * colon = strrchr(arg + 9, ':');
+      options.workerHost = colon ? string(arg + 9, colon) : string();
+      options.workerPort = colon ? atoi(colon + 1) : 0;
+      if (options.workerHost.empty() || options.workerPort <= 0 || options.workerPort > 65535)
+        options.workerPort = -1;
+    }
+    else if (!strncmp(arg, "--journal:", 10))
+      options.journalFile = arg + 10;
+    else if (!strncmp(arg, "--shard:", 8))
+    {
+      if (sscanf(arg + 8, "%d/%d", &options.shardIndex, &options.shardCount) != 2 ||
+        options.shardCount < 1 || options.shardIndex < 1 || options.shardIndex > options.shardCount)
+      {
+        options.shardCount = -1;
+      }
+    }
+    else if (!strncmp(arg, "--merge-results:", 16))
+      options.mergeResults.push_back(arg + 16);
+    else if (!strcmp(arg, "--batch"))
+      options.batch = true;
+    else if (!strncmp(arg, "--file-time-budget:", 19))
+    {
+      options.fileTimeBudgetMs = atoi(arg + 19);
+      if (options.fileTimeBudgetMs < 0)
+        options.fileTimeBudgetMs = 0;
+    }
+    else if (!strncmp(arg, "--prefetch:", 11))
+    {
+      options.prefetchFiles = atoi(arg + 11);
+      if (options.prefetchFiles < 0)
+        options.prefetchFiles = 0;
+    }
+    else if (!strncmp(arg, "--prefetch-memory:", 18))
+      options.prefetchMemory = size_t(max(atoi(arg + 18), 1)) << 20;
+    else if (!strcmp(arg, "--verbose"))
+      options.verbose = true;
+    else if (!strcmp(arg, "--watch"))
+      options.watch = true;
+    else if (!strncmp(arg, "--dir:", 6))
+      options.inputDirs.push_back(arg + 6);
+    else if (!strncmp(arg, "--include:", 10))
+      options.dirFilter.includeFiles.push_back(arg + 10);
+    else if (!strncmp(arg, "--exclude-dir:", 14))
+      options.dirFilter.excludeDirs.push_back(arg + 14);
+    else if (!strncmp(arg, "--exclude-file:", 15))
+      options.dirFilter.excludeFiles.push_back(arg + 15);
+    else if (arg[0] == '-' && (toupper(arg[1]) == 'W') && isdigit(arg[2]))
+      suppress_warning(options, atoi(arg + 2));
+    else if (arg[0] == '-' && isalpha(arg[1]))
+    {
+      int id = CompilationContext::findWarningId(arg + 1);
+      if (id >= 0)
+        suppress_warning(options, id);
+      else
+        options.argumentErrors.push_back(make_pair(30, string("Cannot suppress warning, text id not found: ") + (arg + 1)));
+    }
+    else
+      used = false;
+
+    if (used)
+      used_args.insert(i);
+  }
+
+  if (inverseWarnings)
+    CompilationContext::inverseWarningsMask(options.suppressedWarnings);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include "compilation_context.h"
+#include "dir_walker.h"
+
+
+// Command line options shared by all analyzed files, parsed once before the analysis starts
+struct AnalyzerOptions
+{
+  OutputMode outputMode;
+  WarningsMask suppressedWarnings; // -wNNN and -warning-text-id, inverted by --inverse-warnings
+  std::vector<std::pair<int, std::string> > argumentErrors; // reported as error of each analyzed file
+  bool printTokensToJson;
+  bool printAstToJson;
+  std::string tokensFileName;
+  std::string astFileName;
+  std::string csqExe;
+  int jobs;
+  bool server;
+  std::string serverSocket; // empty for stdin/stdout
+  std::string cacheDir; // directory of on-disk result cache, empty if cache is disabled
+  std::string cacheUrl; // remote result cache shared by machines, empty if disabled
+  int coordinatorPort; // files are analyzed by worker processes, 0 if disabled, -1 if --coordinator is invalid
+  std::string coordinatorAddress; // address to listen on for workers, loopback unless given explicitly
+  int workerTimeoutSec; // files of a worker which sends no result for this time are handed out again
+  std::string workerHost; // files are received from coordinator
+  int workerPort; // 0 if not a worker, -1 if --worker is invalid
+  std::string journalFile; // log of analyzed files to resume interrupted runs, empty if disabled
+  std::vector<std::string> inputDirs; // --dir, analyzed after files of --files lists
+  DirWalkFilter dirFilter;
+  bool watch;
+  bool batch; // bounded memory for huge file lists
+  int shardIndex; // 1-based
+  int shardCount; // 0 if all files are analyzed, -1 if --shard is invalid
+  std::vector<std::string> mergeResults; // JSON files to merge instead of analysis
+  bool verbose; // scheduling decisions are printed to stderr
+  int fileTimeBudgetMs; // expensive rules are skipped for files analyzed longer, 0 - unlimited
+  int prefetchFiles; // input files read ahead of the analysis, 0 - disabled, -1 - depends on jobs
+  size_t prefetchMemory; // bytes of read ahead files which are not analyzed yet
+
+  AnalyzerOptions();
+};
+
+
+OutputMode str_to_output_mode(const char * str);
+
+// indices of consumed arguments are added to used_args
+void parse_analyzer_options(int argc, char ** argv, AnalyzerOptions & options, std::set<int> & used_args);
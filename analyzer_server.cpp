@@ -0,0 +1,136 @@
+#include "analyzer_server.h"
+#include "compilation_context.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#  include <io.h>
+#  include <fcntl.h>
+#  define dup _dup
+#  define dup2 _dup2
+#  define fdopen _fdopen
+#  define fileno _fileno
+#else
+#  include <errno.h>
+#  include <signal.h>
+#  include <unistd.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#endif
+
+using namespace std;
+
+
+bool read_line(FILE * in, string & line)
+{
+  line.clear();
+  char buffer[4096];
+  while (fgets(buffer, sizeof(buffer), in))
+  {
+    line += buffer;
+    if (!line.empty() && line.back() == '\n')
+      break;
+  }
+
+  if (line.empty())
+    return false;
+
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+    line.pop_back();
+
+  return true;
+}
+
+
+bool run_stdio_server(const ServerSessionHandler & handler)
+{
+  fflush(stdout);
+  int responseFd = dup(fileno(stdout));
+  FILE * out = responseFd >= 0 ? fdopen(responseFd, "wb") : nullptr;
+  if (!out)
+  {
+    CompilationContext::globalError("Server: cannot open stdout for responses.");
+    return false;
+  }
+
+  dup2(fileno(stderr), fileno(stdout));
+
+#if defined(_WIN32)
+  _setmode(fileno(stdin), _O_BINARY); // requests may be binary frames
+#endif
+
+  handler(stdin, out);
+  fclose(out);
+  return true;
+}
+
+
+bool run_socket_server(const char * socket_path, const ServerSessionHandler & handler)
+{
+#if defined(_WIN32)
+  (void)socket_path;
+  (void)handler;
+  CompilationContext::globalError("Server: unix sockets are not supported on this platform, use --server without path.");
+  return false;
+#else
+  signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path))
+  {
+    CompilationContext::globalError((string("Server: socket path is too long '") + socket_path + "'").c_str());
+    return false;
+  }
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path);
+  if (listenFd < 0 || ::bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 8) != 0)
+  {
+    if (listenFd >= 0)
+      close(listenFd);
+    CompilationContext::globalError((string("Server: cannot listen on socket '") + socket_path + "'").c_str());
+    return false;
+  }
+
+  bool serving = true;
+  bool ok = true;
+  while (serving)
+  {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+
+      // e.g. EMFILE, it would fail again immediately
+      CompilationContext::globalError((string("Server: cannot accept connection on socket '") + socket_path + "': " +
+        strerror(errno)).c_str());
+      ok = false;
+      break;
+    }
+
+    int outFd = dup(fd);
+    FILE * in = fdopen(fd, "rb");
+    FILE * out = outFd >= 0 ? fdopen(outFd, "wb") : nullptr;
+    if (in && out)
+      serving = handler(in, out);
+
+    if (in)
+      fclose(in);
+    else
+      close(fd);
+
+    if (out)
+      fclose(out);
+    else if (outFd >= 0)
+      close(outFd);
+  }
+
+  close(listenFd);
+  unlink(socket_path);
+  return ok;
+#endif
+}
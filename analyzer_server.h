@@ -0,0 +1,18 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <stdio.h>
+
+
+// Handles requests of one client until its input ends, returns false to stop the server
+typedef std::function<bool(FILE * in, FILE * out)> ServerSessionHandler;
+
+// stdout is reserved for responses, everything else printed to stdout goes to stderr
+bool run_stdio_server(const ServerSessionHandler & handler);
+
+// clients are served one by one, not supported on Windows
+bool run_socket_server(const char * socket_path, const ServerSessionHandler & handler);
+
+// reads line without end of line characters, returns false at the end of input
+bool read_line(FILE * in, std::string & line);
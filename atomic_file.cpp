@@ -0,0 +1,59 @@
+#include "atomic_file.h"
+
+#include <atomic>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#  include <direct.h>
+#  include <io.h>
+#  include <process.h>
+#  define get_pid() _getpid()
+#  define sync_file(f) _commit(_fileno(f))
+#else
+#  include <unistd.h>
+#  define get_pid() getpid()
+#  define sync_file(f) fsync(fileno(f))
+#endif
+
+using namespace std;
+
+
+bool make_dir(const string & dir_name)
+{
+#if defined(_WIN32)
+  return _mkdir(dir_name.c_str()) == 0 || errno == EEXIST;
+#else
+  return mkdir(dir_name.c_str(), 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+
+bool write_file_atomically(const string & file_name, const string & data, bool sync)
+{
+  static std::atomic<int> tmp_cnt(0);
+
+  // writers of the same file in this and in other processes never share a temporary file
+  string tmpName = file_name + ".tmp." + to_string(get_pid()) + "." + to_string(tmp_cnt++);
+  FILE * f = fopen(tmpName.c_str(), "wb");
+  if (!f)
+    return false;
+
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  if (sync)
+    ok = (fflush(f) == 0 && sync_file(f) == 0) && ok;
+  ok = (fclose(f) == 0) && ok;
+
+  if (ok)
+  {
+#if defined(_WIN32)
+    remove(file_name.c_str());
+#endif
+    ok = rename(tmpName.c_str(), file_name.c_str()) == 0;
+  }
+
+  if (!ok)
+    remove(tmpName.c_str());
+  return ok;
+}
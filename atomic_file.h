@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+
+// Files shared by concurrent analyzers: result and export caches, file costs, journal
+
+bool make_dir(const std::string & dir_name); // true if the directory is created or already exists
+
+// Writes data to a unique temporary file next to file_name and renames it, so concurrent readers never see
+// a partially written file. With 'sync' the data is on disk before the rename.
+bool write_file_atomically(const std::string & file_name, const std::string & data, bool sync = false);
@@ -0,0 +1,225 @@
+#include "child_process.h"
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+#  include <stdlib.h>
+#else
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <stdlib.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+using namespace std;
+
+
+vector<string> split_command_line(const string & command_line)
+{
+  vector<string> args;
+  string arg;
+  bool inQuotes = false;
+  bool hasArg = false;
+
+  for (char c : command_line)
+  {
+    if (c == '"')
+    {
+      inQuotes = !inQuotes;
+      hasArg = true;
+    }
+    else if ((c == ' ' || c == '\t') && !inQuotes)
+    {
+      if (hasArg)
+        args.push_back(arg);
+      arg.clear();
+      hasArg = false;
+    }
+    else
+    {
+      arg += c;
+      hasArg = true;
+    }
+  }
+
+  if (hasArg)
+    args.push_back(arg);
+
+  return args;
+}
+
+
+#if defined(_WIN32)
+#  include <io.h>
+#  define PATH_LIST_DELIM ';'
+#  define DIR_DELIMS "/\\"
+#  define is_executable(name) (_access(name, 0) == 0)
+#else
+#  define PATH_LIST_DELIM ':'
+#  define DIR_DELIMS "/"
+#  define is_executable(name) (access(name, X_OK) == 0)
+#endif
+
+
+bool find_program(const string & name, string & path)
+{
+  if (name.find_first_of(DIR_DELIMS) != string::npos)
+  {
+    path = name;
+    return true;
+  }
+
+  const char * pathEnv = getenv("PATH");
+#if defined(_WIN32)
+  string dirs = pathEnv ? pathEnv : "";
+#else
+  string dirs = pathEnv ? pathEnv : "/usr/bin:/bin";
+#endif
+  for (size_t begin = 0; begin <= dirs.length();)
+  {
+    size_t end = dirs.find(PATH_LIST_DELIM, begin);
+    if (end == string::npos)
+      end = dirs.length();
+
+    string dir = dirs.substr(begin, end - begin);
+    string candidate = (dir.empty() ? string(".") : dir) + "/" + name;
+    if (is_executable(candidate.c_str()))
+    {
+      path = candidate;
+      return true;
+    }
+#if defined(_WIN32)
+    if (is_executable((candidate + ".exe").c_str()))
+    {
+      path = candidate + ".exe";
+      return true;
+    }
+#endif
+    begin = end + 1;
+  }
+
+  return false;
+}
+
+
+#if defined(_WIN32)
+
+static const int cmd_not_found_exit_code = 9009;
+
+bool run_process(const vector<string> & args, string & output, int & exit_code)
+{
+  output.clear();
+  if (args.empty())
+    return false;
+
+  // _popen goes through cmd.exe, the whole line is quoted because cmd.exe strips the outer quotes
+  string commandLine = "\"";
+  for (size_t i = 0; i < args.size(); i++)
+    commandLine += (i ? " \"" : "\"") + args[i] + "\"";
+  commandLine += "\"";
+
+  FILE * f = _popen(commandLine.c_str(), "rt");
+  if (!f)
+    return false;
+
+  char buffer[4096];
+  size_t len = 0;
+  while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    output.append(buffer, len);
+
+  exit_code = _pclose(f);
+  return exit_code != cmd_not_found_exit_code;
+}
+
+#else
+
+// pipes must not leak into processes spawned by other threads, otherwise their read ends wait for them too
+static bool cloexec_pipe(int fd[2])
+{
+#if defined(__linux__)
+  return pipe2(fd, O_CLOEXEC) == 0;
+#else
+  if (pipe(fd) != 0)
+    return false;
+  fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+  return true;
+#endif
+}
+
+
+bool run_process(const vector<string> & args, string & output, int & exit_code)
+{
+  output.clear();
+  string path;
+  if (args.empty() || !find_program(args[0], path))
+    return false;
+
+  vector<char *> argv;
+  for (const string & a : args)
+    argv.push_back(const_cast<char *>(a.c_str()));
+  argv.push_back(nullptr);
+
+  // errno of failed exec is written to errorPipe, successful exec closes it without data
+  int outPipe[2];
+  int errorPipe[2];
+  if (!cloexec_pipe(outPipe))
+    return false;
+  if (!cloexec_pipe(errorPipe))
+  {
+    close(outPipe[0]);
+    close(outPipe[1]);
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    if (dup2(outPipe[1], 1) >= 0)
+      execv(path.c_str(), argv.data());
+    int err = errno;
+    ssize_t written = write(errorPipe[1], &err, sizeof(err));
+    (void)written;
+    _exit(127);
+  }
+
+  close(outPipe[1]);
+  close(errorPipe[1]);
+  if (pid < 0)
+  {
+    close(outPipe[0]);
+    close(errorPipe[0]);
+    return false;
+  }
+
+  int execError = 0;
+  ssize_t errorLen = 0;
+  while ((errorLen = read(errorPipe[0], &execError, sizeof(execError))) < 0 && errno == EINTR)
+    ;
+  close(errorPipe[0]);
+
+  char buffer[4096];
+  for (;;)
+  {
+    ssize_t len = read(outPipe[0], buffer, sizeof(buffer));
+    if (len > 0)
+      output.append(buffer, size_t(len));
+    else if (len == 0 || errno != EINTR)
+      break;
+  }
+  close(outPipe[0]);
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0)
+    if (errno != EINTR)
+      return false;
+
+  if (errorLen > 0)
+    return false;
+
+  exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+  return true;
+}
+
+#endif
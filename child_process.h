@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// Splits command line into program and arguments, double quotes group words ("--csq-exe:sq -m" is two words)
+std::vector<std::string> split_command_line(const std::string & command_line);
+
+// Full path of the program as run_process() finds it: names with a directory are used as they are, other names
+// are searched in PATH (also with ".exe" on Windows). Returns false if the program is not found.
+bool find_program(const std::string & name, std::string & path);
+
+// Runs program and collects its stdout, stderr is inherited. Returns false if program cannot be started
+// (e.g. not found), otherwise exit_code is set. POSIX runs the program without shell, Windows runs it through cmd.exe.
+bool run_process(const std::vector<std::string> & args, std::string & output, int & exit_code);
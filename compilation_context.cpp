@@ -1,6 +1,7 @@
 #include "compilation_context.h"
 #include "quirrel_lexer.h"
 #include <string.h>
+#include <stdarg.h>
 #include <algorithm>
 
 using namespace std;
@@ -10,7 +11,10 @@ FILE * out_stream = stdout;
 std::set<std::string> CompilationContext::shownMessages;
 std::vector<CompilerMessage> CompilationContext::compilerMessages;
 const char * CompilationContext::redirectMessagesToJson = nullptr;
+bool CompilationContext::quietMessages = false;
+void (*CompilationContext::messageSink)(const CompilerMessage & cm) = nullptr;
 int CompilationContext::errorLevel = 0;
+thread_local FileReport * CompilationContext::activeReport = nullptr;
 
 struct AnalyzerMessage
 {
@@ -380,6 +384,10 @@ AnalyzerMessage analyzer_messages[] =
     286, "func-in-expression",
     "Function used in expression."
   },
+  {
+    287, "time-budget-exceeded",
+    "Analysis took longer than %s ms, skipped rules: %s."
+  },
 };
 
 
@@ -413,7 +421,7 @@ void CompilationContext::setFileName(const string & file_name)
 void CompilationContext::getNearestStrings(int line_num, std::string & nearest_strings, std::string & cur_string) const
 {
   int line = 1;
-  int start = is_utf8_bom(code.c_str(), 0) ? 3 : 0;
+  int start = code.hasUtf8Bom() ? 3 : 0;
 
   for (int i = start; i < int(code.length()); i++)
   {
@@ -447,6 +455,151 @@ static const char * only_file_name_and_ext(const char * path)
 }
 
 
+static string format_text(const char * format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  va_list argsCopy;
+  va_copy(argsCopy, args);
+  int len = vsnprintf(nullptr, 0, format, argsCopy);
+  va_end(argsCopy);
+
+  string res;
+  if (len > 0)
+  {
+    res.resize(len + 1);
+    vsnprintf(&res[0], len + 1, format, args);
+    res.resize(len);
+  }
+  va_end(args);
+  return res;
+}
+
+
+bool CompilationContext::emit(ReportedEvent & ev)
+{
+  if (activeReport)
+  {
+    activeReport->events.push_back(ReportedEvent());
+    std::swap(activeReport->events.back(), ev);
+    return true;
+  }
+
+  return publish(ev);
+}
+
+
+bool CompilationContext::publish(const ReportedEvent & ev)
+{
+  switch (ev.type)
+  {
+  case RE_MESSAGE:
+    if (!ev.hash.empty())
+    {
+      if (shownMessages.find(ev.hash) != shownMessages.end())
+        return false;
+
+      shownMessages.insert(ev.hash);
+    }
+
+    if (!ev.text.empty())
+      fputs(ev.text.c_str(), out_stream);
+
+    if (ev.errorLevel > errorLevel)
+      errorLevel = ev.errorLevel;
+
+    if (messageSink)
+      messageSink(ev.cm);
+    else
+      compilerMessages.push_back(ev.cm);
+    return true;
+
+  case RE_TEXT:
+    fputs(ev.text.c_str(), out_stream);
+    return true;
+
+  case RE_STDOUT_TEXT:
+    fputs(ev.text.c_str(), stdout);
+    return true;
+
+  case RE_ERROR_LEVEL:
+    if (ev.errorLevel > errorLevel)
+      errorLevel = ev.errorLevel;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+
+void CompilationContext::printText(const char * text)
+{
+  ReportedEvent ev;
+  ev.type = RE_TEXT;
+  ev.text = text;
+  emit(ev);
+}
+
+
+ReportedEvent CompilationContext::eventFromMessage(const CompilerMessage & cm, OutputMode output_mode)
+{
+  ReportedEvent ev;
+  ev.cm = cm;
+  bool isGlobal = cm.fileName.empty();
+  ev.errorLevel = isGlobal ? ERRORLEVEL_FATAL : cm.isError ? ERRORLEVEL_ERROR : ERRORLEVEL_WARNING;
+
+  if (!isGlobal)
+    ev.hash = (cm.isError ? std::to_string(cm.intId) : std::string(cm.textId)) + std::to_string(cm.line) + "_" +
+      std::to_string(cm.column) + "_" + only_file_name_and_ext(cm.fileName.c_str());
+
+  if (redirectMessagesToJson || quietMessages)
+    return ev;
+
+  if (isGlobal)
+    ev.text = format_text("ERROR: %s\n", cm.message.c_str());
+  else if (cm.isError && output_mode == OM_1_LINE)
+    ev.text = format_text("ERR: e%d %s  %s:%d:%d\n", cm.intId, cm.message.c_str(), only_file_name_and_ext(cm.fileName.c_str()),
+      cm.line, cm.column);
+  else if (cm.isError)
+    ev.text = format_text("ERROR: e%d %s\n  %s:%d:%d\n", cm.intId, cm.message.c_str(), cm.fileName.c_str(), cm.line, cm.column);
+  else if (output_mode == OM_1_LINE)
+    ev.text = format_text("WARN: %s  %s:%d:%d\n", cm.textId, only_file_name_and_ext(cm.fileName.c_str()), cm.line, cm.column);
+  else
+    ev.text = format_text("WARNING: w%d (%s)  %s\n  %s:%d:%d\n", cm.intId, cm.textId, cm.message.c_str(), cm.fileName.c_str(),
+      cm.line, cm.column);
+
+  return ev;
+}
+
+
+void CompilationContext::renameEventFile(ReportedEvent & ev, const std::string & file_name)
+{
+  if (ev.type != RE_MESSAGE || ev.cm.fileName.empty())
+    return;
+
+  const CompilerMessage & cm = ev.cm;
+  std::string oldShortName = only_file_name_and_ext(cm.fileName.c_str());
+  std::string newShortName = only_file_name_and_ext(file_name.c_str());
+  std::string position = ":" + std::to_string(cm.line) + ":" + std::to_string(cm.column);
+
+  if (ev.hash.length() >= oldShortName.length())
+    ev.hash.replace(ev.hash.length() - oldShortName.length(), oldShortName.length(), newShortName);
+
+  // location follows the message text, which can contain anything
+  size_t from = ev.text.find(cm.message);
+  from = (from == std::string::npos) ? 0 : from + cm.message.length();
+
+  size_t pos = ev.text.find(cm.fileName + position, from);
+  if (pos != std::string::npos)
+    ev.text.replace(pos, cm.fileName.length(), file_name);
+  else if ((pos = ev.text.find(oldShortName + position, from)) != std::string::npos)
+    ev.text.replace(pos, oldShortName.length(), newShortName);
+
+  ev.cm.fileName = file_name;
+}
+
+
 void CompilationContext::error(int error_code, const char * error, int line, int col)
 {
   if (isError)
@@ -456,34 +609,38 @@ void CompilationContext::error(int error_code, const char * error, int line, int
 
   isError = true;
 
-  string hash = std::to_string(error_code) + std::to_string(line) + "_" + std::to_string(col) +
+  ReportedEvent ev;
+  ev.hash = std::to_string(error_code) + std::to_string(line) + "_" + std::to_string(col) +
     "_" + only_file_name_and_ext(fileName.c_str());
-  if (shownMessages.find(hash) != shownMessages.end())
-    return;
 
-  shownMessages.insert(hash);
-  std::string nearestStrings, curString;
-  getNearestStrings(line, nearestStrings, curString);
+  if (!activeReport && shownMessages.find(ev.hash) != shownMessages.end())
+    return;
 
-  if (!redirectMessagesToJson)
+  if (!redirectMessagesToJson && !quietMessages)
   {
     if (outputMode == OM_1_LINE)
-      fprintf(out_stream, "ERR: e%d %s  %s:%d:%d\n", error_code, error, only_file_name_and_ext(fileName.c_str()), line, col);
+      ev.text = format_text("ERR: e%d %s  %s:%d:%d\n", error_code, error, only_file_name_and_ext(fileName.c_str()), line, col);
     else if (outputMode == OM_2_LINES)
-      fprintf(out_stream, "ERROR: e%d %s\n  %s:%d:%d\n", error_code, error, fileName.c_str(), line, col);
+      ev.text = format_text("ERROR: e%d %s\n  %s:%d:%d\n", error_code, error, fileName.c_str(), line, col);
     else
-      fprintf(out_stream, "ERROR: e%d %s\nat %s:%d:%d\n%s\n\n\n", error_code, error, fileName.c_str(), line, col, nearestStrings.c_str());
+    {
+      std::string nearestStrings, curString;
+      getNearestStrings(line, nearestStrings, curString);
+      ev.text = format_text("ERROR: e%d %s\nat %s:%d:%d\n%s\n\n\n", error_code, error, fileName.c_str(), line, col,
+        nearestStrings.c_str());
+    }
   }
-  shownWarningsAndErrors.push_back(error_code);
 
-  CompilerMessage cm;
+  CompilerMessage & cm = ev.cm;
   cm.line = line;
   cm.column = col;
   cm.intId = error_code;
   cm.isError = true;
   cm.message = error;
   cm.fileName = fileName;
-  compilerMessages.push_back(cm);
+
+  if (emit(ev))
+    shownWarningsAndErrors.push_back(error_code);
 }
 
 
@@ -491,17 +648,18 @@ void CompilationContext::globalError(const char * error)
 {
   CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
 
-  if (!redirectMessagesToJson)
-    fprintf(out_stream, "ERROR: %s\n", error);
+  ReportedEvent ev;
+  if (!redirectMessagesToJson && !quietMessages)
+    ev.text = format_text("ERROR: %s\n", error);
 
-  CompilerMessage cm;
+  CompilerMessage & cm = ev.cm;
   cm.line = 0;
   cm.column = 0;
   cm.intId = 0;
   cm.isError = true;
   cm.message = error;
   cm.fileName = "";
-  compilerMessages.push_back(cm);
+  emit(ev);
 }
 
 
@@ -534,9 +692,8 @@ void CompilationContext::warning(const char * text_id, const Token & tok, const
     return;
   }
 
-  for (size_t i = 0; i < suppressWarnings.size(); i++)
-    if (warningCode == suppressWarnings[i])
-      return;
+  if (warningCode >= 0 && warningCode < MAX_MESSAGE_ID && suppressWarnings.test(warningCode))
+    return;
 
   char suppressLineIntBuf[64];
   char suppressLineTextBuf[128];
@@ -570,32 +727,29 @@ void CompilationContext::warning(const char * text_id, const Token & tok, const
     return;
 
 
-  string hash = std::string(text_id) + std::to_string(line) + "_" + std::to_string(col) +
+  ReportedEvent ev;
+  ev.hash = std::string(text_id) + std::to_string(line) + "_" + std::to_string(col) +
     "_" + only_file_name_and_ext(fileName.c_str());
-  if (shownMessages.find(hash) != shownMessages.end())
-    return;
+  ev.errorLevel = ERRORLEVEL_WARNING;
 
-  shownMessages.insert(hash);
+  if (!activeReport && shownMessages.find(ev.hash) != shownMessages.end())
+    return;
 
   char warningText[512] = { 0 };
   snprintf(warningText, sizeof(warningText), analyzer_messages[msgIndex].messageText, arg0, arg1, arg2, arg3);
 
-  if (!redirectMessagesToJson)
+  if (!redirectMessagesToJson && !quietMessages)
   {
     if (outputMode == OM_1_LINE)
-      fprintf(out_stream, "WARN: %s  %s:%d:%d\n", text_id, only_file_name_and_ext(fileName.c_str()), line, col);
+      ev.text = format_text("WARN: %s  %s:%d:%d\n", text_id, only_file_name_and_ext(fileName.c_str()), line, col);
     else if (outputMode == OM_2_LINES)
-      fprintf(out_stream, "WARNING: w%d (%s)  %s\n  %s:%d:%d\n", warningCode, text_id, warningText, fileName.c_str(), line, col);
+      ev.text = format_text("WARNING: w%d (%s)  %s\n  %s:%d:%d\n", warningCode, text_id, warningText, fileName.c_str(), line, col);
     else
-      fprintf(out_stream, "WARNING: w%d (%s)  %s\nat %s:%d:%d\n%s\n\n\n", warningCode, text_id, warningText, fileName.c_str(),
+      ev.text = format_text("WARNING: w%d (%s)  %s\nat %s:%d:%d\n%s\n\n\n", warningCode, text_id, warningText, fileName.c_str(),
         line, col, nearestStrings.c_str());
   }
 
-  isWarning = true;
-  setErrorLevel(ERRORLEVEL_WARNING);
-  shownWarningsAndErrors.push_back(warningCode);
-
-  CompilerMessage cm;
+  CompilerMessage & cm = ev.cm;
   cm.line = line;
   cm.column = col;
   cm.intId = warningCode;
@@ -604,7 +758,11 @@ void CompilationContext::warning(const char * text_id, const Token & tok, const
   cm.message = warningText;
   cm.fileName = fileName;
 
-  compilerMessages.push_back(cm);
+  if (!emit(ev))
+    return;
+
+  isWarning = true;
+  shownWarningsAndErrors.push_back(warningCode);
 }
 
 
@@ -619,7 +777,7 @@ void CompilationContext::offsetToLineAndCol(int offset, int & line, int & col) c
 {
   line = 1;
   col = 1;
-  int start = is_utf8_bom(code.c_str(), 0) ? 3 : 0;
+  int start = code.hasUtf8Bom() ? 3 : 0;
 
   for (int i = start; i < int(code.length()); i++)
   {
@@ -642,70 +800,57 @@ void CompilationContext::offsetToLineAndCol(int offset, int & line, int & col) c
 
 void CompilationContext::clearSuppressedWarnings()
 {
-  suppressWarnings.clear();
+  suppressWarnings.reset();
 }
 
 
-void CompilationContext::suppressWaring(int int_id)
+void CompilationContext::setSuppressedWarnings(const WarningsMask & mask)
 {
-  for (size_t i = 0; i < suppressWarnings.size(); i++)
-    if (int_id == suppressWarnings[i])
-    {
-      error(31, (string("Warning is already suppressed: w") + to_string(int_id)).c_str(), 0, 0);
-      return;
-    }
-
-  suppressWarnings.push_back(int_id);
+  suppressWarnings = mask;
 }
 
 
-void CompilationContext::suppressWaring(const char * text_id)
+int CompilationContext::findWarningId(const char * text_id)
 {
   for (int i = 0; i < sizeof(analyzer_messages) / sizeof(analyzer_messages[0]); i++)
     if (!strcmp(text_id, analyzer_messages[i].textId))
-    {
-      suppressWaring(analyzer_messages[i].intId);
-      return;
-    }
+      return analyzer_messages[i].intId;
 
-  error(30, (string("Cannot suppress warning, text id not found: ") + text_id).c_str(), 0, 0);
+  return -1;
 }
 
 
-bool CompilationContext::isWarningSuppressed(const char * text_id)
+const char * CompilationContext::findWarningTextId(int int_id)
 {
-  int id = -1;
   for (int i = 0; i < sizeof(analyzer_messages) / sizeof(analyzer_messages[0]); i++)
-    if (!strcmp(text_id, analyzer_messages[i].textId))
-    {
-      id = analyzer_messages[i].intId;
-      break;
-    }
+    if (analyzer_messages[i].intId == int_id)
+      return analyzer_messages[i].textId;
 
-  return (std::find(suppressWarnings.begin(), suppressWarnings.end(), id) != suppressWarnings.end());
+  return "";
 }
 
 
-void CompilationContext::inverseWarningsSuppression()
+bool CompilationContext::isWarningSuppressed(const char * text_id)
 {
-  std::vector<int> newSuppressWarnings;
+  int id = findWarningId(text_id);
+  return id >= 0 && id < MAX_MESSAGE_ID && suppressWarnings.test(id);
+}
+
+
+void CompilationContext::inverseWarningsMask(WarningsMask & mask)
+{
+  WarningsMask newMask;
   for (int i = 0; i < sizeof(analyzer_messages) / sizeof(analyzer_messages[0]); i++)
-  {
-    bool found = false;
-    for (size_t j = 0; j < suppressWarnings.size(); j++)
-    {
-      if (analyzer_messages[i].intId == suppressWarnings[j])
-      {
-        found = true;
-        break;
-      }
-    }
+    if (!mask.test(analyzer_messages[i].intId))
+      newMask.set(analyzer_messages[i].intId);
+
+  mask = newMask;
+}
 
-    if (!found)
-      newSuppressWarnings.push_back(analyzer_messages[i].intId);
-  }
 
-  suppressWarnings = newSuppressWarnings;
+void CompilationContext::inverseWarningsSuppression()
+{
+  inverseWarningsMask(suppressWarnings);
 }
 
 
@@ -721,6 +866,15 @@ void CompilationContext::printAllWarningsList()
 
 void CompilationContext::setErrorLevel(int error_level)
 {
+  if (activeReport)
+  {
+    ReportedEvent ev;
+    ev.type = RE_ERROR_LEVEL;
+    ev.errorLevel = error_level;
+    emit(ev);
+    return;
+  }
+
   if (error_level > errorLevel)
     errorLevel = error_level;
 }
@@ -735,4 +889,22 @@ void CompilationContext::clearErrorLevel()
   errorLevel = 0;
 }
 
+void CompilationContext::resetMessages()
+{
+  compilerMessages.clear();
+  shownMessages.clear();
+  errorLevel = 0;
+}
+
+void CompilationContext::swapMessages(std::vector<CompilerMessage> & messages, std::set<std::string> & shown,
+  int & error_level)
+{
+  compilerMessages.swap(messages);
+  shownMessages.swap(shown);
+  std::swap(errorLevel, error_level);
+}
 
+void CompilationContext::swapShownMessages(std::set<std::string> & hashes)
+{
+  shownMessages.swap(hashes);
+}
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <bitset>
 #include <set>
 #include <string>
 #include <vector>
 #include <stdio.h>
 #include "quirrel/importParser/importParser.h"
+#include "source_text.h"
 
 bool is_utf8_bom(const char * ptr, int i);
 
@@ -26,6 +28,9 @@ enum ErrorLevels
   ERRORLEVEL_FATAL = 4,
 };
 
+static const int MAX_MESSAGE_ID = 1024;
+typedef std::bitset<MAX_MESSAGE_ID> WarningsMask; // bit is set for suppressed warning
+
 struct CompilerMessage
 {
   int line;
@@ -46,9 +51,40 @@ struct CompilerMessage
   }
 };
 
+enum ReportedEventType
+{
+  RE_MESSAGE, // error or warning, deduplicated by hash on publish
+  RE_TEXT, // raw text for out_stream
+  RE_STDOUT_TEXT, // raw text for stdout (output of child processes)
+  RE_ERROR_LEVEL,
+  RE_CONFIG, // .sqconfig switch, resolved by the driver
+};
+
+struct ReportedEvent
+{
+  ReportedEventType type;
+  int errorLevel;
+  std::string hash; // empty for messages that are never deduplicated
+  std::string text;
+  std::string requiresUndeclared; // publish only if this identifier was never declared in files published before
+  CompilerMessage cm;
+
+  ReportedEvent()
+  {
+    type = RE_MESSAGE;
+    errorLevel = 0;
+  }
+};
+
+// Output of a single file collected by a worker thread, published later in the order of input files
+struct FileReport
+{
+  std::vector<ReportedEvent> events;
+};
+
 class CompilationContext
 {
-  std::vector<int> suppressWarnings;
+  WarningsMask suppressWarnings;
   static std::set<std::string> shownMessages;
   static int errorLevel;
 
@@ -68,14 +104,28 @@ public:
   std::set<std::string> stringList;
   std::string fileName;
   std::string fileDir;
-  std::string code;
+  SourceText code;
   std::vector<int> shownWarningsAndErrors;
   std::vector<sqimportparser::ModuleImport> imports;
   static std::vector<CompilerMessage> compilerMessages;
   static const char * redirectMessagesToJson;
+  static bool quietMessages; // messages are only collected, e.g. for responses of the analyzer server
   static void setErrorLevel(int error_level);
   static int getErrorLevel();
   static void clearErrorLevel();
+  static void resetMessages();
+  // published messages, dedupe state and error level are exchanged, e.g. a server request starts from empty state
+  static void swapMessages(std::vector<CompilerMessage> & messages, std::set<std::string> & shown, int & error_level);
+  static void swapShownMessages(std::set<std::string> & hashes); // batch mode keeps dedupe state per file
+  static void (*messageSink)(const CompilerMessage & cm); // if set, published messages go here instead of compilerMessages
+  static thread_local FileReport * activeReport; // messages of current thread are collected here instead of output
+  static bool emit(ReportedEvent & ev); // publish now or collect into activeReport
+  static bool publish(const ReportedEvent & ev);
+  static void printText(const char * text);
+  // event with the same hash as error() or warning() would make, text of OM_FULL has no source lines
+  static ReportedEvent eventFromMessage(const CompilerMessage & cm, OutputMode output_mode);
+  // message of a file is changed to be a message of another file with the same content
+  static void renameEventFile(ReportedEvent & ev, const std::string & file_name);
   int firstLineAfterImport;
   bool isError;
   bool isWarning;
@@ -92,10 +142,12 @@ public:
     const char * arg2 = "???", const char * arg3 = "???");
   void offsetToLineAndCol(int offset, int & line, int & col) const;
   void clearSuppressedWarnings();
-  void suppressWaring(int intId);
-  void suppressWaring(const char * textId);
+  void setSuppressedWarnings(const WarningsMask & mask);
   bool isWarningSuppressed(const char * text_id);
   void inverseWarningsSuppression();
+  static int findWarningId(const char * text_id); // -1 if not found
+  static const char * findWarningTextId(int int_id); // "" if not found
+  static void inverseWarningsMask(WarningsMask & mask);
   static void printAllWarningsList();
 };
 
@@ -0,0 +1,267 @@
+#include "content_hash.h"
+#include <string.h>
+
+using namespace std;
+
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+
+ContentHash::ContentHash()
+{
+  h1 = 0x9368e53c2f6af274ULL;
+  h2 = 0x586dcd208f7cd3fdULL;
+  tail = 0;
+  tailBytes = 0;
+  length = 0;
+}
+
+
+void ContentHash::mixBlock(uint64_t block)
+{
+  uint64_t k1 = block * 0x87c37b91114253d5ULL;
+  k1 = rotl64(k1, 31);
+  k1 *= 0x4cf5ad432745937fULL;
+  h1 ^= k1;
+  h1 = rotl64(h1, 27) + h2;
+  h1 = h1 * 5 + 0x52dce729;
+
+  uint64_t k2 = block * 0x4cf5ad432745937fULL;
+  k2 = rotl64(k2, 33);
+  k2 *= 0x87c37b91114253d5ULL;
+  h2 ^= k2;
+  h2 = rotl64(h2, 31) + h1;
+  h2 = h2 * 5 + 0x38495ab5;
+}
+
+
+void ContentHash::add(const void * data, size_t size)
+{
+  const unsigned char * p = (const unsigned char *)data;
+  length += size;
+
+  while (size > 0 && tailBytes > 0)
+  {
+    tail |= uint64_t(*p) << (tailBytes * 8);
+    p++;
+    size--;
+    if (++tailBytes == 8)
+    {
+      mixBlock(tail);
+      tail = 0;
+      tailBytes = 0;
+    }
+  }
+
+  for (; size >= 8; size -= 8, p += 8)
+  {
+    uint64_t block = 0;
+    for (int i = 7; i >= 0; i--)
+      block = (block << 8) | p[i];
+    mixBlock(block);
+  }
+
+  for (; size > 0; size--, p++)
+    tail |= uint64_t(*p) << (tailBytes++ * 8);
+}
+
+
+void ContentHash::add(const string & str)
+{
+  add(uint64_t(str.length()));
+  add(str.data(), str.length());
+}
+
+
+void ContentHash::add(uint64_t value)
+{
+  unsigned char bytes[8];
+  for (int i = 0; i < 8; i++)
+    bytes[i] = (unsigned char)(value >> (i * 8));
+  add(bytes, sizeof(bytes));
+}
+
+
+string ContentHash::hex() const
+{
+  uint64_t a = h1;
+  uint64_t b = h2;
+  if (tailBytes > 0)
+  {
+    uint64_t k1 = tail * 0x87c37b91114253d5ULL;
+    k1 = rotl64(k1, 31);
+    a ^= k1 * 0x4cf5ad432745937fULL;
+  }
+
+  a ^= length;
+  b ^= length;
+  a += b;
+  b += a;
+  a = fmix64(a);
+  b = fmix64(b);
+  a += b;
+  b += a;
+
+  static const char * digits = "0123456789abcdef";
+  string res(32, '0');
+  for (int i = 0; i < 16; i++)
+  {
+    res[i] = digits[(a >> (60 - i * 4)) & 15];
+    res[16 + i] = digits[(b >> (60 - i * 4)) & 15];
+  }
+  return res;
+}
+
+
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+
+Sha1Hash::Sha1Hash()
+{
+  state[0] = 0x67452301;
+  state[1] = 0xefcdab89;
+  state[2] = 0x98badcfe;
+  state[3] = 0x10325476;
+  state[4] = 0xc3d2e1f0;
+  blockBytes = 0;
+  length = 0;
+}
+
+
+void Sha1Hash::processBlock(const unsigned char * data)
+{
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++)
+    w[i] = (uint32_t(data[i * 4]) << 24) | (uint32_t(data[i * 4 + 1]) << 16) |
+      (uint32_t(data[i * 4 + 2]) << 8) | uint32_t(data[i * 4 + 3]);
+  for (int i = 16; i < 80; i++)
+    w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  uint32_t a = state[0];
+  uint32_t b = state[1];
+  uint32_t c = state[2];
+  uint32_t d = state[3];
+  uint32_t e = state[4];
+
+  for (int i = 0; i < 80; i++)
+  {
+    uint32_t f, k;
+    if (i < 20)
+    {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    }
+    else if (i < 40)
+    {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    }
+    else if (i < 60)
+    {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    }
+    else
+    {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+
+    uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rotl32(b, 30);
+    b = a;
+    a = t;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+
+void Sha1Hash::add(const void * data, size_t size)
+{
+  const unsigned char * p = (const unsigned char *)data;
+  length += size;
+
+  if (blockBytes > 0)
+  {
+    size_t n = size < 64 - blockBytes ? size : 64 - blockBytes;
+    memcpy(block + blockBytes, p, n);
+    blockBytes += n;
+    p += n;
+    size -= n;
+    if (blockBytes < 64)
+      return;
+    processBlock(block);
+    blockBytes = 0;
+  }
+
+  for (; size >= 64; size -= 64, p += 64)
+    processBlock(p);
+
+  memcpy(block, p, size);
+  blockBytes = size;
+}
+
+
+void Sha1Hash::add(const string & str)
+{
+  add(uint64_t(str.length()));
+  add(str.data(), str.length());
+}
+
+
+void Sha1Hash::add(uint64_t value)
+{
+  unsigned char bytes[8];
+  for (int i = 0; i < 8; i++)
+    bytes[i] = (unsigned char)(value >> (i * 8));
+  add(bytes, sizeof(bytes));
+}
+
+
+string Sha1Hash::hex() const
+{
+  Sha1Hash h = *this;
+  uint64_t bitLength = length * 8;
+  unsigned char padding[72] = { 0x80 };
+  size_t padLen = (blockBytes < 56 ? 56 : 120) - blockBytes;
+  for (int i = 0; i < 8; i++)
+    padding[padLen + i] = (unsigned char)(bitLength >> (56 - i * 8));
+  h.add(padding, padLen + 8);
+
+  static const char * digits = "0123456789abcdef";
+  string res(40, '0');
+  for (int i = 0; i < 40; i++)
+    res[i] = digits[(h.state[i / 8] >> (28 - (i % 8) * 4)) & 15];
+  return res;
+}
+
+
+string content_hash_hex(const string & str)
+{
+  ContentHash hash;
+  hash.add(str.data(), str.length());
+  return hash.hex();
+}
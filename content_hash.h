@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+
+// 128-bit non-cryptographic hash of a sequence of values, used for keys which do not leave this machine
+class ContentHash
+{
+  uint64_t h1;
+  uint64_t h2;
+  uint64_t tail;
+  int tailBytes;
+  uint64_t length;
+
+  void mixBlock(uint64_t block);
+
+public:
+  ContentHash();
+  void add(const void * data, size_t size);
+  void add(const std::string & str); // length-prefixed, so sequences of strings are unambiguous
+  void add(uint64_t value);
+  std::string hex() const; // 32 hex digits
+};
+
+
+// SHA-1 of a sequence of values with the same encoding as ContentHash, used for keys of results shared
+// between machines (--cache-url), where a collision would replay the report of another file
+class Sha1Hash
+{
+  uint32_t state[5];
+  unsigned char block[64];
+  size_t blockBytes;
+  uint64_t length;
+
+  void processBlock(const unsigned char * data);
+
+public:
+  Sha1Hash();
+  void add(const void * data, size_t size);
+  void add(const std::string & str); // length-prefixed, so sequences of strings are unambiguous
+  void add(uint64_t value);
+  std::string hex() const; // 40 hex digits
+};
+
+std::string content_hash_hex(const std::string & str);
@@ -0,0 +1,326 @@
+#include "dir_walker.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <ctype.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <dirent.h>
+#endif
+
+using namespace std;
+
+
+bool glob_match(const char * pattern, const char * str)
+{
+  const char * starPattern = nullptr;
+  const char * starStr = nullptr;
+
+  while (*str)
+  {
+    if (*pattern == '*')
+    {
+      starPattern = ++pattern;
+      starStr = str;
+      continue;
+    }
+
+    bool matched = false;
+    const char * nextPattern = pattern + 1;
+
+    if (*pattern == '?')
+      matched = true;
+    else if (*pattern == '[')
+    {
+      const char * p = pattern + 1;
+      bool negate = (*p == '!' || *p == '^');
+      if (negate)
+        p++;
+
+      bool inSet = false;
+      const char * setBegin = p;
+      while (*p && (*p != ']' || p == setBegin))
+      {
+        if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+          if (*str >= p[0] && *str <= p[2])
+            inSet = true;
+          p += 3;
+        }
+        else
+        {
+          if (*str == *p)
+            inSet = true;
+          p++;
+        }
+      }
+
+      if (*p == ']')
+      {
+        matched = (inSet != negate);
+        nextPattern = p + 1;
+      }
+      else
+        matched = (*str == '['); // unterminated set is a plain character
+    }
+    else
+      matched = (*pattern && *pattern == *str);
+
+    if (matched)
+    {
+      pattern = nextPattern;
+      str++;
+    }
+    else if (starPattern)
+    {
+      pattern = starPattern;
+      str = ++starStr;
+    }
+    else
+      return false;
+  }
+
+  while (*pattern == '*')
+    pattern++;
+
+  return !*pattern;
+}
+
+
+bool is_directory(const string & path)
+{
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+
+static bool match_any(const vector<string> & patterns, const string & name)
+{
+  for (const string & pattern : patterns)
+    if (glob_match(pattern.c_str(), name.c_str()))
+      return true;
+
+  return false;
+}
+
+
+string join_path(const string & dir, const string & name)
+{
+  if (dir.empty())
+    return name;
+
+  char last = dir[dir.length() - 1];
+  return (last == '/' || last == '\\') ? dir + name : dir + "/" + name;
+}
+
+
+bool dir_walk_accepts_dir(const DirWalkFilter & filter, const string & dir_name)
+{
+  if (dir_name == "CVS" || dir_name == ".git")
+    return false;
+
+  return !match_any(filter.excludeDirs, dir_name);
+}
+
+
+bool dir_walk_accepts_file(const DirWalkFilter & filter, const string & file_name)
+{
+  string lowerName = file_name;
+  transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+
+  if (filter.includeFiles.empty() ? !glob_match("*.nut", lowerName.c_str()) : !match_any(filter.includeFiles, lowerName))
+    return false;
+
+  return !match_any(filter.excludeFiles, lowerName);
+}
+
+
+// symbolic links to directories are not followed, like in os.walk() of drey
+static void list_directory(const string & dir, vector<string> & files, vector<string> & dirs)
+{
+#if defined(_WIN32)
+  WIN32_FIND_DATAA fd;
+  HANDLE h = FindFirstFileA(join_path(dir, "*").c_str(), &fd);
+  if (h == INVALID_HANDLE_VALUE)
+    return;
+
+  do
+  {
+    if (!strcmp(fd.cFileName, ".") || !strcmp(fd.cFileName, ".."))
+      continue;
+
+    if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+      if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+        dirs.push_back(fd.cFileName);
+    }
+    else
+      files.push_back(fd.cFileName);
+  } while (FindNextFileA(h, &fd));
+
+  FindClose(h);
+#else
+  DIR * d = opendir(dir.c_str());
+  if (!d)
+    return;
+
+  while (struct dirent * entry = readdir(d))
+  {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      continue;
+
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN)
+    {
+      struct stat st;
+      if (lstat(join_path(dir, entry->d_name).c_str(), &st) != 0)
+        continue;
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+    }
+
+    if (type == DT_DIR)
+      dirs.push_back(entry->d_name);
+    else if (type == DT_LNK)
+    {
+      if (!is_directory(join_path(dir, entry->d_name)))
+        files.push_back(entry->d_name);
+    }
+    else
+      files.push_back(entry->d_name);
+  }
+
+  closedir(d);
+#endif
+}
+
+
+namespace
+{
+  struct DirNode
+  {
+    string path;
+    bool listed = false;
+    vector<string> files;
+    vector<unique_ptr<DirNode> > subdirs;
+  };
+
+  struct DirWalk
+  {
+    const DirWalkFilter & filter;
+
+    mutex walkMutex;
+    condition_variable walkCv;
+    deque<DirNode *> pending;
+    bool finished = false;
+    bool serial = false; // each directory is listed by emit() right before its files are needed
+
+    DirWalk(const DirWalkFilter & filter_) : filter(filter_) {}
+
+    void listNode(DirNode * node)
+    {
+      vector<string> files;
+      vector<string> dirs;
+      list_directory(node->path, files, dirs);
+      sort(files.begin(), files.end());
+      sort(dirs.begin(), dirs.end());
+
+      vector<string> acceptedFiles;
+      for (const string & name : files)
+        if (dir_walk_accepts_file(filter, name))
+          acceptedFiles.push_back(join_path(node->path, name));
+
+      vector<unique_ptr<DirNode> > subdirs;
+      for (const string & name : dirs)
+        if (dir_walk_accepts_dir(filter, name))
+        {
+          subdirs.push_back(unique_ptr<DirNode>(new DirNode));
+          subdirs.back()->path = join_path(node->path, name);
+        }
+
+      {
+        lock_guard<mutex> lock(walkMutex);
+        node->files.swap(acceptedFiles);
+        node->subdirs.swap(subdirs);
+        node->listed = true;
+        if (!serial)
+          for (auto && sub : node->subdirs)
+            pending.push_back(sub.get());
+      }
+      walkCv.notify_all();
+    }
+
+    void workerLoop()
+    {
+      for (;;)
+      {
+        DirNode * node = nullptr;
+        {
+          unique_lock<mutex> lock(walkMutex);
+          walkCv.wait(lock, [&]() { return !pending.empty() || finished; });
+          if (pending.empty())
+            return;
+          node = pending.front();
+          pending.pop_front();
+        }
+        listNode(node);
+      }
+    }
+
+    void emit(DirNode * node, const function<void(const string &)> & found)
+    {
+      if (serial)
+        listNode(node);
+
+      {
+        unique_lock<mutex> lock(walkMutex);
+        walkCv.wait(lock, [&]() { return node->listed; });
+      }
+
+      for (const string & file : node->files)
+        found(file);
+      node->files.clear();
+
+      for (auto && sub : node->subdirs)
+      {
+        emit(sub.get(), found);
+        sub.reset(); // the subtree is not needed anymore
+      }
+    }
+  };
+}
+
+
+void walk_directory(const string & root, const DirWalkFilter & filter, int jobs,
+  const function<void(const string &)> & found)
+{
+  DirWalk walk(filter);
+  DirNode rootNode;
+  rootNode.path = root;
+
+  walk.serial = (jobs <= 1);
+  if (!walk.serial)
+    walk.pending.push_back(&rootNode);
+
+  vector<thread> threads;
+  for (int j = 0; !walk.serial && j < jobs; j++)
+    threads.push_back(thread([&]() { walk.workerLoop(); }));
+
+  walk.emit(&rootNode, found);
+
+  {
+    lock_guard<mutex> lock(walk.walkMutex);
+    walk.finished = true;
+  }
+  walk.walkCv.notify_all();
+
+  for (thread & t : threads)
+    t.join();
+}
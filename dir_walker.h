@@ -0,0 +1,27 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// Filters of --dir walk, same semantics as dirs_to_skip and files_to_skip of .dreyconfig:
+// directory patterns are matched against each directory name below the root,
+// file patterns are matched against lower case file name.
+struct DirWalkFilter
+{
+  std::vector<std::string> includeFiles; // "*.nut" if empty
+  std::vector<std::string> excludeDirs; // "CVS" and ".git" are always excluded
+  std::vector<std::string> excludeFiles;
+};
+
+bool glob_match(const char * pattern, const char * str); // fnmatch-like: '*', '?', '[abc]', '[!a-z]'
+bool is_directory(const std::string & path);
+std::string join_path(const std::string & dir, const std::string & name);
+bool dir_walk_accepts_dir(const DirWalkFilter & filter, const std::string & dir_name);
+bool dir_walk_accepts_file(const DirWalkFilter & filter, const std::string & file_name);
+
+// Lists directories on 'jobs' threads. found() is called on the calling thread in stable order
+// (sorted files of directory, then its sorted subdirectories), as soon as all preceding directories are listed.
+void walk_directory(const std::string & root, const DirWalkFilter & filter, int jobs,
+  const std::function<void(const std::string &)> & found);
@@ -0,0 +1,349 @@
+#include "distributed.h"
+#include "compilation_context.h"
+#include "stream_frames.h"
+#include "tcp_connection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+
+static const int accept_poll_ms = 200;
+static const int connect_attempts = 120; // coordinator may be started after workers
+static const int connect_retry_ms = 250;
+
+
+static void write_index(string & out, uint64_t index)
+{
+  for (int i = 0; i < 8; i++)
+    out += char((index >> (i * 8)) & 0xFF);
+}
+
+static bool read_index(const string & payload, uint64_t & index)
+{
+  if (payload.size() < 8)
+    return false;
+
+  index = 0;
+  for (int i = 7; i >= 0; i--)
+    index = (index << 8) | (unsigned char)payload[i];
+  return true;
+}
+
+
+static bool send_frame(TcpConnection & conn, int type, const string & payload)
+{
+  string frame;
+  write_stream_frame(frame, type, payload.data(), payload.size());
+  return conn.sendAll(frame);
+}
+
+
+static bool read_frame(TcpConnection & conn, StreamFrame & frame)
+{
+  string header;
+  if (!conn.readExact(5, header))
+    return false;
+
+  const unsigned char * h = (const unsigned char *)header.data();
+  size_t length = size_t(h[1]) | (size_t(h[2]) << 8) | (size_t(h[3]) << 16) | (size_t(h[4]) << 24);
+  frame.type = h[0];
+  return conn.readExact(length, frame.payload);
+}
+
+
+struct CoordinatorState
+{
+  mutex stateMutex;
+  condition_variable stateCv;
+  deque<size_t> pending; // files which are not handed out, files of disconnected workers are returned to the front
+  vector<bool> finished;
+  bool allDone;
+};
+
+
+static void serve_worker(TcpConnection & conn, CoordinatorState & state, const string & run_digest,
+  const vector<string> & file_names, bool verbose, const function<bool(size_t, const string &)> & result)
+{
+  string header;
+  StreamFrame frame;
+  if (!conn.readExact(STREAM_FRAMES_HEADER_SIZE, header) || !is_stream_frames_header(header.data(), header.size()) ||
+    !read_frame(conn, frame) || frame.type != SF_WORKER_HELLO)
+  {
+    return;
+  }
+
+  size_t eol = frame.payload.find('\n');
+  int workerJobs = eol == string::npos ? 1 : max(atoi(frame.payload.c_str() + eol + 1), 1);
+  if (frame.payload.substr(0, eol) != run_digest)
+  {
+    send_frame(conn, SF_WORKER_REJECTED,
+      "worker is started with other options, predefinition files or analyzer build than the coordinator");
+    if (verbose)
+      fprintf(stderr, "Coordinator: worker with other inputs is rejected\n");
+    return;
+  }
+
+  if (verbose)
+    fprintf(stderr, "Coordinator: worker with %d thread(s) is connected\n", workerJobs);
+
+  // files are queued on the worker, so its threads do not wait for the next file
+  size_t window = size_t(workerJobs) * 2;
+  set<size_t> inFlight;
+  int analyzed = 0;
+  bool failed = false;
+
+  for (;;)
+  {
+    vector<size_t> toSend;
+    {
+      unique_lock<mutex> lock(state.stateMutex);
+      state.stateCv.wait(lock, [&]() { return state.allDone || !state.pending.empty() || !inFlight.empty(); });
+      if (state.allDone)
+        break;
+
+      while (inFlight.size() < window && !state.pending.empty())
+      {
+        toSend.push_back(state.pending.front());
+        inFlight.insert(state.pending.front());
+        state.pending.pop_front();
+      }
+    }
+
+    string frames;
+    for (size_t i : toSend)
+    {
+      string payload;
+      write_index(payload, i);
+      payload += file_names[i];
+      write_stream_frame(frames, SF_WORK, payload.data(), payload.size());
+    }
+
+    uint64_t index = 0;
+    if ((!frames.empty() && !conn.sendAll(frames)) || !read_frame(conn, frame) || frame.type != SF_WORK_RESULT ||
+      !read_index(frame.payload, index) || inFlight.find(size_t(index)) == inFlight.end() ||
+      !result(size_t(index), frame.payload.substr(8)))
+    {
+      failed = true;
+      break;
+    }
+
+    analyzed++;
+    {
+      lock_guard<mutex> lock(state.stateMutex);
+      inFlight.erase(size_t(index));
+      state.finished[size_t(index)] = true;
+    }
+    state.stateCv.notify_all();
+  }
+
+  if (failed)
+  {
+    {
+      lock_guard<mutex> lock(state.stateMutex);
+      for (auto it = inFlight.rbegin(); it != inFlight.rend(); ++it)
+        state.pending.push_front(*it);
+    }
+    state.stateCv.notify_all();
+
+    if (verbose)
+      fprintf(stderr, "Coordinator: worker is disconnected after %d file(s), %d file(s) are handed out again\n",
+        analyzed, int(inFlight.size()));
+    return;
+  }
+
+  send_frame(conn, SF_EXIT, string());
+  if (verbose)
+    fprintf(stderr, "Coordinator: worker analyzed %d file(s)\n", analyzed);
+}
+
+
+bool run_coordinator(const string & address, int port, int result_timeout_sec, const string & run_digest,
+  const vector<string> & file_names,
+  const vector<size_t> & start_order, bool verbose, const function<bool(size_t, const string &)> & result,
+  const function<void(size_t)> & done)
+{
+  TcpListener listener;
+  if (!listener.listen(address, port))
+  {
+    CompilationContext::globalError(("Coordinator: cannot listen on " + address + ":" + to_string(port)).c_str());
+    return false;
+  }
+
+  CoordinatorState state;
+  state.allDone = false;
+  state.finished.assign(file_names.size(), false);
+  if (start_order.size() == file_names.size())
+    state.pending.assign(start_order.begin(), start_order.end());
+  else
+    for (size_t i = 0; i < file_names.size(); i++)
+      state.pending.push_back(i);
+
+  if (verbose)
+    fprintf(stderr, "Coordinator: %d file(s), waiting for workers on %s:%d\n", int(file_names.size()), address.c_str(), port);
+
+  vector<unique_ptr<TcpConnection>> connections;
+  vector<thread> connectionThreads;
+  mutex connectionsMutex;
+
+  thread acceptor([&]()
+  {
+    for (;;)
+    {
+      {
+        lock_guard<mutex> lock(state.stateMutex);
+        if (state.allDone)
+          return;
+      }
+
+      unique_ptr<TcpConnection> conn(new TcpConnection());
+      if (!listener.accept(*conn, accept_poll_ms))
+        continue;
+
+      // a worker which hangs is handled as disconnected, its files are handed out to other workers
+      conn->setTimeout(result_timeout_sec);
+
+      lock_guard<mutex> lock(connectionsMutex);
+      TcpConnection * c = conn.get();
+      connections.push_back(std::move(conn));
+      connectionThreads.push_back(thread([&, c]() { serve_worker(*c, state, run_digest, file_names, verbose, result); }));
+    }
+  });
+
+  for (size_t i = 0; i < file_names.size(); i++)
+  {
+    {
+      unique_lock<mutex> lock(state.stateMutex);
+      state.stateCv.wait(lock, [&]() { return bool(state.finished[i]); });
+    }
+    done(i);
+  }
+
+  {
+    lock_guard<mutex> lock(state.stateMutex);
+    state.allDone = true;
+  }
+  state.stateCv.notify_all();
+  acceptor.join();
+
+  // idle workers get SF_EXIT, connections which did not finish the handshake are dropped
+  lock_guard<mutex> lock(connectionsMutex);
+  for (unique_ptr<TcpConnection> & conn : connections)
+    conn->shutdown();
+  for (thread & t : connectionThreads)
+    t.join();
+
+  listener.close();
+  return true;
+}
+
+
+bool run_worker(const string & host, int port, const string & run_digest, int jobs, bool verbose,
+  const function<void(const string &, string &)> & work)
+{
+  TcpConnection conn;
+  for (int attempt = 0; attempt < connect_attempts && !conn.connect(host, port); attempt++)
+    this_thread::sleep_for(chrono::milliseconds(connect_retry_ms));
+
+  if (!conn.isOpen())
+  {
+    CompilationContext::globalError(("Worker: cannot connect to coordinator " + host + ":" + to_string(port)).c_str());
+    return false;
+  }
+
+  conn.setTimeout(0); // coordinator may wait for other workers for a long time
+  jobs = max(jobs, 1);
+
+  string hello;
+  write_stream_frames_header(hello);
+  string helloPayload = run_digest + "\n" + to_string(jobs);
+  write_stream_frame(hello, SF_WORKER_HELLO, helloPayload.data(), helloPayload.size());
+  if (!conn.sendAll(hello))
+  {
+    CompilationContext::globalError("Worker: cannot send request to coordinator");
+    return false;
+  }
+
+  mutex queueMutex;
+  condition_variable queueCv;
+  deque<pair<uint64_t, string>> queue;
+  bool inputEnded = false;
+  mutex sendMutex;
+  int analyzed = 0;
+
+  vector<thread> threads;
+  for (int j = 0; j < jobs; j++)
+    threads.push_back(thread([&]()
+    {
+      for (;;)
+      {
+        pair<uint64_t, string> item;
+        {
+          unique_lock<mutex> lock(queueMutex);
+          queueCv.wait(lock, [&]() { return inputEnded || !queue.empty(); });
+          if (queue.empty())
+            return;
+          item = queue.front();
+          queue.pop_front();
+        }
+
+        string payload;
+        write_index(payload, item.first);
+        string res;
+        work(item.second, res);
+        payload += res;
+
+        lock_guard<mutex> lock(sendMutex);
+        send_frame(conn, SF_WORK_RESULT, payload);
+        analyzed++;
+      }
+    }));
+
+  bool rejected = false;
+  StreamFrame frame;
+  while (read_frame(conn, frame))
+  {
+    uint64_t index = 0;
+    if (frame.type == SF_WORK && read_index(frame.payload, index))
+    {
+      {
+        lock_guard<mutex> lock(queueMutex);
+        queue.push_back(make_pair(index, frame.payload.substr(8)));
+      }
+      queueCv.notify_one();
+    }
+    else if (frame.type == SF_WORKER_REJECTED)
+    {
+      CompilationContext::globalError(("Worker: rejected by coordinator, " + frame.payload).c_str());
+      rejected = true;
+      break;
+    }
+    else if (frame.type == SF_EXIT)
+      break;
+  }
+
+  // coordinator does not wait for results after exit or disconnection
+  {
+    lock_guard<mutex> lock(queueMutex);
+    queue.clear();
+    inputEnded = true;
+  }
+  queueCv.notify_all();
+  conn.shutdown();
+  for (thread & t : threads)
+    t.join();
+
+  if (verbose)
+    fprintf(stderr, "Worker: analyzed %d file(s)\n", analyzed);
+
+  return !rejected;
+}
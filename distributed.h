@@ -0,0 +1,27 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// Distributed analysis: coordinator (--coordinator:<port>) hands out input files to worker processes
+// (--worker:<host>:<port>) over TCP as soon as workers finish previous files, so slow workers and expensive
+// files do not hold up the run. Workers must see the same source tree and must be started with the same options,
+// it is checked by the digest of run inputs. Connection starts with the stream frames header from the worker,
+// then frames of stream_frames.h: SF_WORKER_HELLO from the worker, SF_WORK (or SF_WORKER_REJECTED) from the
+// coordinator, SF_WORK_RESULT from the worker, SF_EXIT from the coordinator when all files are done.
+
+// result(i, data) is called on connection threads when the result of i-th file comes, it returns false if data is
+// invalid. done(i) is called on the calling thread in the order of files. Files of disconnected workers, and of workers
+// which send no result for result_timeout_sec (0 - wait forever), are handed out again.
+// Returns false if port cannot be listened.
+bool run_coordinator(const std::string & address, int port, int result_timeout_sec, const std::string & run_digest,
+  const std::vector<std::string> & file_names,
+  const std::vector<size_t> & start_order, bool verbose, const std::function<bool(size_t, const std::string &)> & result,
+  const std::function<void(size_t)> & done);
+
+// work(file_name, result) is called on 'jobs' threads. Returns false if coordinator is not available
+// or rejected the worker.
+bool run_worker(const std::string & host, int port, const std::string & run_digest, int jobs, bool verbose,
+  const std::function<void(const std::string &, std::string &)> & work);
@@ -0,0 +1,114 @@
+"""Stand-in server of the remote result cache (--cache-url) for tests and self-hosting.
+
+GET /<path>/<key> returns the entry or 404, PUT /<path>/<key> stores it. Entries are kept in the same
+layout as --cache-dir, so the directory can also be used as a local cache.
+
+    python result_cache_server.py --port 8780 --dir /var/cache/qsa
+    quirrel_static_analyzer --cache-url:http://localhost:8780/ ...
+"""
+
+import argparse
+import os
+import re
+import sys
+import threading
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+except ImportError:
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+    from SocketServer import ThreadingMixIn
+
+key_re = re.compile(r"^[0-9a-f]{40}$")
+tmp_counter = [0]
+tmp_lock = threading.Lock()
+
+
+class ThreadingServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+class CacheHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1" # keep-alive, the analyzer pipelines requests
+    cache_dir = "."
+    verbose = False
+
+    def entry_path(self):
+        key = self.path.rstrip("/").split("/")[-1]
+        if not key_re.match(key):
+            return None
+        return os.path.join(self.cache_dir, key[:2], key[2:] + ".qsa")
+
+    def reply(self, status, body=b""):
+        self.send_response(status)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        path = self.entry_path()
+        if path is None or not os.path.isfile(path):
+            self.reply(404)
+            return
+        with open(path, "rb") as f:
+            self.reply(200, f.read())
+
+    def do_PUT(self):
+        length = int(self.headers.get("Content-Length", "0"))
+        body = self.rfile.read(length)
+        path = self.entry_path()
+        if path is None:
+            self.reply(400)
+            return
+
+        # unique temporary file and rename, so concurrent readers never see a partial entry
+        dirname = os.path.dirname(path)
+        if not os.path.isdir(dirname):
+            try:
+                os.makedirs(dirname)
+            except OSError:
+                pass
+        with tmp_lock:
+            tmp_counter[0] += 1
+            tmp_name = os.path.join(dirname, "tmp.{0}.{1}".format(os.getpid(), tmp_counter[0]))
+        with open(tmp_name, "wb") as f:
+            f.write(body)
+        try:
+            os.replace(tmp_name, path)
+        except AttributeError:
+            if os.path.exists(path):
+                os.remove(path)
+            os.rename(tmp_name, path)
+        self.reply(201)
+
+    def log_message(self, format, *args):
+        if self.verbose:
+            BaseHTTPRequestHandler.log_message(self, format, *args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="result cache server for quirrel_static_analyzer --cache-url")
+    parser.add_argument("--port", type=int, default=8780)
+    parser.add_argument("--bind", default="127.0.0.1", help="address to listen on, 0.0.0.0 to share with other machines")
+    parser.add_argument("--dir", default="qsa_cache", help="directory of cache entries")
+    parser.add_argument("--verbose", action="store_true", help="print requests")
+    args = parser.parse_args()
+
+    CacheHandler.cache_dir = args.dir
+    CacheHandler.verbose = args.verbose
+    if not os.path.isdir(args.dir):
+        os.makedirs(args.dir)
+
+    server = ThreadingServer((args.bind, args.port), CacheHandler)
+    print("Serving result cache '{0}' on http://{1}:{2}/".format(args.dir, args.bind, server.server_address[1]))
+    sys.stdout.flush()
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,192 @@
+#include "file_watcher.h"
+
+#include <vector>
+#include <string.h>
+
+#if defined(__linux__)
+#  include <poll.h>
+#  include <unistd.h>
+#  include <sys/inotify.h>
+#  include <dirent.h>
+#endif
+
+using namespace std;
+
+
+#if defined(__linux__)
+
+static const uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+
+FileWatcher::FileWatcher(const DirWalkFilter & recursive_filter) : filter(recursive_filter)
+{
+  fd = inotify_init1(IN_CLOEXEC);
+}
+
+
+FileWatcher::~FileWatcher()
+{
+  if (fd >= 0)
+    close(fd);
+}
+
+
+bool FileWatcher::isSupported()
+{
+  return true;
+}
+
+
+// files that already exist in new subdirectory are added to found_files, their events were missed
+bool FileWatcher::addWatch(const string & dir, bool recursive, set<string> * found_files)
+{
+  if (fd < 0)
+    return false;
+
+  int wd = inotify_add_watch(fd, dir.empty() ? "." : dir.c_str(), watch_mask);
+  if (wd < 0)
+    return false;
+
+  // the same directory can be added by different paths, inotify returns the same descriptor for it
+  WatchedDir watched = { dir, recursive };
+  auto ins = watches.insert(make_pair(wd, watched));
+  if (!ins.second)
+    ins.first->second.recursive |= recursive;
+
+  if (!recursive && !found_files)
+    return true;
+
+  DIR * d = opendir(dir.empty() ? "." : dir.c_str());
+  if (!d)
+    return true;
+
+  vector<string> subdirs;
+  while (struct dirent * entry = readdir(d))
+  {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      continue;
+
+    string path = join_path(dir, entry->d_name);
+    if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && is_directory(path)))
+    {
+      if (recursive && dir_walk_accepts_dir(filter, entry->d_name))
+        subdirs.push_back(path);
+    }
+    else if (found_files)
+      found_files->insert(path);
+  }
+  closedir(d);
+
+  for (const string & sub : subdirs)
+    addWatch(sub, true, found_files);
+
+  return true;
+}
+
+
+bool FileWatcher::watch(const string & dir, bool recursive)
+{
+  return addWatch(dir, recursive, nullptr);
+}
+
+
+bool FileWatcher::readEvents(set<string> & changed_files)
+{
+  alignas(struct inotify_event) char buf[16384];
+  ssize_t len = read(fd, buf, sizeof(buf));
+  if (len <= 0)
+    return false;
+
+  for (char * ptr = buf; ptr < buf + len; )
+  {
+    const struct inotify_event * ev = (const struct inotify_event *)ptr;
+    ptr += sizeof(struct inotify_event) + ev->len;
+
+    if (ev->mask & IN_IGNORED)
+    {
+      watches.erase(ev->wd);
+      continue;
+    }
+
+    auto it = watches.find(ev->wd);
+    if (it == watches.end() || ev->len == 0)
+      continue;
+
+    string path = join_path(it->second.path, ev->name);
+
+    if (ev->mask & IN_ISDIR)
+    {
+      if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) && it->second.recursive && dir_walk_accepts_dir(filter, ev->name))
+        addWatch(path, true, &changed_files);
+      continue;
+    }
+
+    if (ev->mask & IN_CREATE)
+      continue; // file is reported again by IN_CLOSE_WRITE
+
+    changed_files.insert(path);
+  }
+
+  return true;
+}
+
+
+bool FileWatcher::wait(set<string> & changed_files, int settle_ms)
+{
+  if (fd < 0)
+    return false;
+
+  if (!readEvents(changed_files))
+    return false;
+
+  for (;;)
+  {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, settle_ms) <= 0)
+      return true;
+
+    if (!readEvents(changed_files))
+      return false;
+  }
+}
+
+#else
+
+FileWatcher::FileWatcher(const DirWalkFilter & recursive_filter) : filter(recursive_filter)
+{
+  fd = -1;
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+
+bool FileWatcher::isSupported()
+{
+  return false;
+}
+
+bool FileWatcher::addWatch(const string &, bool, set<string> *)
+{
+  return false;
+}
+
+bool FileWatcher::watch(const string &, bool)
+{
+  return false;
+}
+
+bool FileWatcher::readEvents(set<string> &)
+{
+  return false;
+}
+
+bool FileWatcher::wait(set<string> &, int)
+{
+  return false;
+}
+
+#endif
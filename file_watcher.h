@@ -0,0 +1,32 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include "dir_walker.h"
+
+
+// Notifications about changed files in watched directories (inotify, Linux only)
+class FileWatcher
+{
+  struct WatchedDir
+  {
+    std::string path; // as given by user, prefix of reported file names
+    bool recursive;
+  };
+
+  int fd;
+  std::map<int, WatchedDir> watches; // watch descriptor -> directory
+  DirWalkFilter filter; // subdirectories of recursive watches
+
+  bool addWatch(const std::string & dir, bool recursive, std::set<std::string> * found_files);
+  bool readEvents(std::set<std::string> & changed_files);
+
+public:
+  FileWatcher(const DirWalkFilter & recursive_filter);
+  ~FileWatcher();
+  static bool isSupported();
+  bool watch(const std::string & dir, bool recursive);
+  // blocks until files are changed, then collects names of files changed until there is a pause of settle_ms
+  bool wait(std::set<std::string> & changed_files, int settle_ms);
+};
@@ -0,0 +1,89 @@
+#include "job_schedule.h"
+#include "atomic_file.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+
+vector<size_t> schedule_largest_first(const vector<ScheduledFile> & files)
+{
+  struct Group
+  {
+    uint64_t maxCost;
+    size_t firstPos; // keeps the input order of groups with equal cost
+    vector<size_t> items;
+  };
+
+  map<string, Group> groups;
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    auto ins = groups.insert(make_pair(files[i].group, Group{ 0, i, vector<size_t>() }));
+    Group & g = ins.first->second;
+    g.maxCost = max(g.maxCost, files[i].cost);
+    g.items.push_back(i);
+  }
+
+  vector<Group *> order;
+  for (auto && g : groups)
+  {
+    stable_sort(g.second.items.begin(), g.second.items.end(), [&](size_t a, size_t b)
+    {
+      return files[a].cost > files[b].cost;
+    });
+    order.push_back(&g.second);
+  }
+
+  sort(order.begin(), order.end(), [](const Group * a, const Group * b)
+  {
+    return a->maxCost != b->maxCost ? a->maxCost > b->maxCost : a->firstPos < b->firstPos;
+  });
+
+  vector<size_t> res;
+  res.reserve(files.size());
+  for (const Group * g : order)
+    res.insert(res.end(), g->items.begin(), g->items.end());
+
+  return res;
+}
+
+
+void load_file_costs(const string & file_name, map<string, uint64_t> & costs)
+{
+  FILE * f = fopen(file_name.c_str(), "rt");
+  if (!f)
+    return;
+
+  char line[4096];
+  while (fgets(line, sizeof(line), f))
+  {
+    char * name = nullptr;
+    unsigned long long tokens = strtoull(line, &name, 10);
+    if (!name || *name != ' ')
+      continue;
+
+    name++;
+    size_t len = strlen(name);
+    while (len > 0 && (name[len - 1] == '\n' || name[len - 1] == '\r'))
+      name[--len] = 0;
+
+    if (len > 0 && tokens > 0)
+      costs[name] = uint64_t(tokens);
+  }
+
+  fclose(f);
+}
+
+
+void save_file_costs(const string & file_name, const map<string, uint64_t> & costs)
+{
+  string text;
+  for (auto && c : costs)
+    text += to_string((unsigned long long)c.second) + " " + c.first + "\n";
+
+  // concurrent analyzers must not see a partially written file
+  write_file_atomically(file_name, text);
+}
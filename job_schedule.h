@@ -0,0 +1,23 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+// Order in which worker threads start analysis of files, results are still published in the order of input
+
+struct ScheduledFile
+{
+  std::string group; // files sharing .sqconfig and directory, they reuse the same settings and export tables
+  uint64_t cost;
+};
+
+// Groups are started from the one with the most expensive file, files of a group follow each other,
+// the most expensive first. Returns indices of files in the order of starting.
+std::vector<size_t> schedule_largest_first(const std::vector<ScheduledFile> & files);
+
+// token counts of files from previous runs, lines '<tokens> <file name>'
+void load_file_costs(const std::string & file_name, std::map<std::string, uint64_t> & costs);
+void save_file_costs(const std::string & file_name, const std::map<std::string, uint64_t> & costs);
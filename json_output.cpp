@@ -166,31 +166,85 @@ bool ast_to_json(const char * file_name, Node * node)
 }
 
 
-bool compiler_messages_to_json(const char * file_name)
+static void append_compiler_message(const CompilerMessage & cm, string & s)
 {
-  string s("\"messages\":[");
-  bool first = true;
   char txt[2048] = { 0 };
+  string escapedMsg;
+  string escapedFile;
+  escapeJSON(cm.message.c_str(), escapedMsg);
+  escapeJSON(cm.fileName.c_str(), escapedFile);
+
+  snprintf(txt, sizeof(txt) - 1,
+    "\n{\"line\":%d,\"col\":%d,\"len\":4,\"file\":\"%s\",\"intId\":%d,\"textId\":\"%s\",\"message\":\"%s\",\"isError\":%s}",
+    cm.line, cm.column, escapedFile.c_str(), cm.intId, cm.textId, escapedMsg.c_str(), cm.isError ? "true" : "false");
+
+  s += txt;
+}
+
+
+void get_compiler_messages_as_string(string & s)
+{
+  s += "\"messages\":[";
+  bool first = true;
 
   for (CompilerMessage & cm : CompilationContext::compilerMessages)
   {
     if (!first)
       s += ",";
 
-    string escapedMsg;
-    string escapedFile;
-    escapeJSON(cm.message.c_str(), escapedMsg);
-    escapeJSON(cm.fileName.c_str(), escapedFile);
-
-    snprintf(txt, sizeof(txt) - 1,
-      "\n{\"line\":%d,\"col\":%d,\"len\":4,\"file\":\"%s\",\"intId\":%d,\"textId\":\"%s\",\"message\":\"%s\",\"isError\":%s}",
-      cm.line, cm.column, escapedFile.c_str(), cm.intId, cm.textId, escapedMsg.c_str(), cm.isError ? "true" : "false");
-
-    s += txt;
+    append_compiler_message(cm, s);
     first = false;
   }
   s += "]";
+}
+
+
+static FILE * messages_stream = nullptr;
+static bool messages_stream_empty = true;
+static bool messages_stream_ok = true;
+
+
+bool compiler_messages_stream_begin(const char * file_name)
+{
+  messages_stream = *file_name ? fopen(file_name, "wt") : out_stream;
+  if (!messages_stream)
+  {
+    CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
+    fprintf(out_stream, "ERROR: cannot write to file '%s'\n", file_name);
+    return false;
+  }
+
+  messages_stream_empty = true;
+  messages_stream_ok = fputs("{\n\"messages\":[", messages_stream) >= 0;
+  return messages_stream_ok;
+}
 
+
+void compiler_messages_stream_write(const CompilerMessage & cm)
+{
+  if (!messages_stream)
+    return;
+
+  string s = messages_stream_empty ? "" : ",";
+  append_compiler_message(cm, s);
+  messages_stream_ok &= fputs(s.c_str(), messages_stream) >= 0;
+  messages_stream_empty = false;
+}
+
+
+bool compiler_messages_to_json(const char * file_name)
+{
+  if (messages_stream)
+  {
+    bool ok = messages_stream_ok && fputs("]\n}", messages_stream) >= 0;
+    if (messages_stream != out_stream)
+      ok &= (fclose(messages_stream) == 0);
+    messages_stream = nullptr;
+    return ok;
+  }
+
+  string s;
+  get_compiler_messages_as_string(s);
   append_content(file_name, s);
 
   return true;
@@ -7,4 +7,9 @@
 bool tokens_to_json(const char * file_name, Lexer & lexer);
 bool ast_to_json(const char * file_name, Node * node);
 bool compiler_messages_to_json(const char * file_name);
+void get_compiler_messages_as_string(std::string & s);
 bool json_write_files();
+
+// batch mode: messages are written as soon as they are published, compiler_messages_to_json() closes the stream
+bool compiler_messages_stream_begin(const char * file_name);
+void compiler_messages_stream_write(const CompilerMessage & cm);
@@ -1,16 +1,31 @@
 #include "module_exports.h"
+#include "atomic_file.h"
+#include "child_process.h"
+#include "content_hash.h"
+#include "dir_walker.h"
+#include "source_text.h"
 
+#include <deque>
 #include <map>
+#include <memory>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #if defined(_WIN32)
+#  include <direct.h>
 #  include <process.h>
-#  define NULL_FILE_NAME "nul"
+#  define get_cwd(buf, size) _getcwd(buf, size)
 #else
 #  include <unistd.h>
-#  define NULL_FILE_NAME "/dev/null"
+#  define get_cwd(buf, size) getcwd(buf, size)
 #endif
 
 using namespace std;
@@ -18,44 +33,72 @@ using namespace std;
 namespace moduleexports
 {
   string csq_exe = "csq";
+  string export_cache_dir;
 
-  static int tmp_cnt = 0;
+  static std::atomic<int> tmp_cnt(0);
+
+  //  identifier, parents
+  typedef map<string, vector<string> > ExportTable;
 
   //  module_file_name ("" = root), identifier, parents
-  map< string, map<string, vector<string> > > module_content; // module content
-  map< string, map<string, vector<string> > > module_to_root; // root table for each module
+  map< string, ExportTable > module_content; // module content
+  map< string, shared_ptr<const ExportTable> > module_to_root; // root table for each module, shared with analyzing threads
+  static std::mutex modules_mutex; // guards module_content, module_to_root, cached_module_keys and collecting_keys
+  static std::condition_variable collected_cv;
+  static set<string> collecting_keys; // collected by other threads now, they are waited for instead of running csq again
+  static deque<string> cached_module_keys; // in order of collection
+  size_t max_cached_modules = 0;
 
 
-  //  identifier, parents
-  map<string, vector<string> > root;
+  // root table of the analyzed file, collected tables are shared by all files and are never changed
+  thread_local shared_ptr<const ExportTable> root_table;
+
+  static void use_root_table(const shared_ptr<const ExportTable> & table, bool is_module)
+  {
+    if (!is_module)
+    {
+      root_table = table;
+      return;
+    }
+
+    // names added to the root table by a required module
+    shared_ptr<ExportTable> merged = root_table ? make_shared<ExportTable>(*root_table) : make_shared<ExportTable>();
+    merged->insert(table->begin(), table->end());
+    root_table = merged;
+  }
 
   const char * dump_sorted_module_code =
     #include "dump_sorted_module.nut.inl"
     ""
     ;
 
-  bool module_export_collector(CompilationContext & ctx, int line, int col, const char * module_name) // nullptr for roottable
+  static bool is_dump_line(const string & line)
   {
-    string moduleNameKey = ctx.fileDir + "#";
-    moduleNameKey += module_name ? module_name : "";
+    return line.size() >= 4 && line[0] == '.' && line[2] == '.' && line[3] == ' ' &&
+      (line[1] == 'R' || line[1] == 'A' || line[1] == 'M' || line[1] == 'E');
+  }
 
-    auto foundModuleRoot = module_to_root.find(moduleNameKey);
-    if (foundModuleRoot != module_to_root.end())
+  // errors of module execution are printed by csq, keep them in order with the rest of the output,
+  // dumped names are skipped as dump_sorted_module.nut does with --dont-print-table
+  static void print_child_output(const string & output)
+  {
+    ReportedEvent ev;
+    ev.type = RE_STDOUT_TEXT;
+    size_t pos = 0;
+    while (pos < output.size())
     {
-      if (!module_name)
-        root = foundModuleRoot->second;
-      else
-        root.insert(foundModuleRoot->second.begin(), foundModuleRoot->second.end());
-
-      return true;
+      size_t eol = output.find('\n', pos);
+      size_t next = eol == string::npos ? output.size() : eol + 1;
+      if (!is_dump_line(output.substr(pos, next - pos)))
+        ev.text.append(output, pos, next - pos);
+      pos = next;
     }
+    CompilationContext::emit(ev);
+  }
 
-    if (module_name && strchr(module_name, '\"'))
-    {
-      ctx.error(71, "Export collector: Invalid module name.", line, col);
-      return false;
-    }
 
+  static bool run_dump_script(CompilationContext & ctx, int line, int col, const char * module_name, string & output)
+  {
     char uniq[16] = { 0 };
 
 #if defined(_WIN32)
@@ -65,20 +108,15 @@ namespace moduleexports
 #endif
 
     char nutFileName[512] = { 0 };
-    char outputFileName[512] = { 0 };
     snprintf(nutFileName, sizeof(nutFileName), "%s%s~nut%s.%d.tmp", ctx.fileDir.c_str(),
-      ctx.fileDir.empty() ? "" : "/", uniq, tmp_cnt);
-    snprintf(outputFileName, sizeof(outputFileName), "~out%s.%d.tmp", uniq, tmp_cnt);
-    tmp_cnt++;
-
-    //tmpnam(nutFileName);
-    //tmpnam(outputFileName);
+      ctx.fileDir.empty() ? "" : "/", uniq, int(tmp_cnt++));
 
+    // the script is placed near the analyzed file, so relative module names are resolved as in the game
     FILE * fnut = fopen(nutFileName, "wt");
     if (!fnut)
     {
       CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
-      ctx.error(70, "Export collector: Cannot create temporary file.", line, col);
+      ctx.error(ERROR_TEMP_FILE, "Export collector: Cannot create temporary file.", line, col);
       return false;
     }
 
@@ -88,74 +126,69 @@ namespace moduleexports
     fprintf(fnut, "%s", dump_sorted_module_code);
     fclose(fnut);
 
-    if (system((csq_exe + " \"" + nutFileName + "\" > " + outputFileName).c_str()))
-    {
-      if (system((csq_exe + " --version > " NULL_FILE_NAME).c_str()))
-      {
-        CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
-        ctx.error(72, string("Export collector: '" + csq_exe +
-          "' not found. You may disable warnings -w242 and -w246 to continue.").c_str(),
-          line, col);
-        remove(outputFileName);
-        remove(nutFileName);
-        return false;
-      }
+    // csq is started directly and its output is read from a pipe, without shell and temporary output file
+    vector<string> args = split_command_line(csq_exe);
+    args.push_back(nutFileName);
+    int exitCode = 0;
+    bool started = run_process(args, output, exitCode);
+    remove(nutFileName);
 
-      ctx.error(73, "Export collector: code of module executed with errors:\n", line, col);
-      system((csq_exe + " --dont-print-table " + nutFileName).c_str());
-      remove(outputFileName);
-      remove(nutFileName);
+    if (!started)
+    {
+      CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
+      ctx.error(ERROR_CSQ_NOT_FOUND, string("Export collector: '" + csq_exe +
+        "' not found. You may disable warnings -w242 and -w246 to continue.").c_str(),
+        line, col);
       return false;
     }
 
-    remove(nutFileName);
-
-    FILE * fout = fopen(outputFileName, "rt");
-    if (!fout)
+    if (exitCode != 0)
     {
-      CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
-      ctx.error(73, "Export collector: cannot open results of module execution.", line, col);
+      ctx.error(ERROR_MODULE_EXECUTION, "Export collector: code of module executed with errors:\n", line, col);
+      print_child_output(output);
       return false;
     }
 
+    return true;
+  }
 
-    map<string, vector<string> > moduleContent;
-    map<string, vector<string> > moduleRoot;
 
+  // output of dump_sorted_module.nut, returns true if module was not required
+  static bool parse_dump_output(const char * text, size_t length, bool is_module,
+    ExportTable & module_content, ExportTable & module_root)
+  {
     string emptyString = string();
 
-    char buffer[255] = { 0 };
     bool isError = false;
-    while (fgets(buffer, sizeof(buffer) - 1, fout) != NULL)
+    const char * end = text + length;
+    const char * lineBegin = text;
+    while (lineBegin < end)
     {
-      bool isRoot = !strncmp(buffer, ".R. ", 4) && !module_name;
-      bool isAddRoot = !strncmp(buffer, ".A. ", 4) && module_name;
-      bool isModule = !strncmp(buffer, ".M. ", 4) && module_name;
-      isError |= !strncmp(buffer, ".E. ", 4);
+      const char * lineEnd = (const char *)memchr(lineBegin, '\n', end - lineBegin);
+      if (!lineEnd)
+        lineEnd = end;
+      string outputLine(lineBegin, lineEnd);
+      lineBegin = lineEnd + 1;
 
-      map<string, vector<string> > & addTo = isModule ? moduleContent : moduleRoot;
+      bool isRoot = !strncmp(outputLine.c_str(), ".R. ", 4) && !is_module;
+      bool isAddRoot = !strncmp(outputLine.c_str(), ".A. ", 4) && is_module;
+      bool isModule = !strncmp(outputLine.c_str(), ".M. ", 4) && is_module;
+      isError |= !strncmp(outputLine.c_str(), ".E. ", 4);
+
+      ExportTable & addTo = isModule ? module_content : module_root;
 
       if (isRoot || isAddRoot || isModule)
       {
-        const char * s = buffer + 4 - 1;
         vector<string> names;
-        do
+        size_t start = 4;
+        for (;;)
         {
-          s++;
-          const char * dot = strchr(s, '.');
-          if (dot)
-            names.push_back(string(s, dot - s));
-          else
-          {
-            const char * nline = strchr(s, '\n');
-            if (!nline)
-              names.push_back(string(s));
-            else
-              names.push_back(string(s, nline - s));
-          }
-          s = dot;
-        } while (s);
-
+          size_t dot = outputLine.find('.', start);
+          names.push_back(outputLine.substr(start, dot == string::npos ? string::npos : dot - start));
+          if (dot == string::npos)
+            break;
+          start = dot + 1;
+        }
 
         string & parent = names[0];
         string & child = names.size() > 1 ? names[1] : emptyString;
@@ -175,21 +208,162 @@ namespace moduleexports
       }
     }
 
-    if (!module_name)
-      root = moduleRoot;
-    else
-      root.insert(moduleRoot.begin(), moduleRoot.end());
+    return isError;
+  }
+
+
+  // hash of csq command line, csq binary and dump script, empty if csq is not found
+  static std::mutex identity_mutex; // guards identity_csq_exe and identity
+  static string identity_csq_exe;
+  static string identity;
+
+  static string csq_identity()
+  {
+    std::lock_guard<std::mutex> lock(identity_mutex);
+    if (!identity.empty() && identity_csq_exe == csq_exe)
+      return identity;
+
+    vector<string> args = split_command_line(csq_exe);
+    string binaryName;
+    FILE * f = !args.empty() && find_program(args[0], binaryName) ? fopen(binaryName.c_str(), "rb") : nullptr;
+    if (!f)
+      return string();
+
+    ContentHash h;
+    h.add(csq_exe);
+    h.add(string(dump_sorted_module_code));
+    char buf[65536];
+    size_t n = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      h.add(buf, n);
+    fclose(f);
+
+    identity_csq_exe = csq_exe;
+    identity = h.hex();
+    return identity;
+  }
+
+
+  // only the root table is kept on disk, it depends only on csq and on the working directory where csq is started
+  static string export_cache_key()
+  {
+    string identity = csq_identity();
+    if (identity.empty())
+      return string();
+
+    char cwd[4096] = { 0 };
+    ContentHash h;
+    h.add(identity);
+    h.add(string(get_cwd(cwd, sizeof(cwd)) ? cwd : ""));
+    return h.hex();
+  }
+
+
+  static string export_cache_file_name(const string & key)
+  {
+    return join_path(export_cache_dir, key + ".exports");
+  }
+
+
+  static bool load_cached_exports(const string & key, ExportTable & module_content, ExportTable & module_root,
+    bool & is_error)
+  {
+    SourceText text; // entry is mapped into memory
+    if (!text.load(export_cache_file_name(key)))
+      return false;
+
+    is_error = parse_dump_output(text.c_str(), text.length(), false, module_content, module_root);
+    return true;
+  }
+
+
+  static void store_cached_exports(const string & key, const string & output)
+  {
+    size_t delim = export_cache_dir.find_last_of("/\\");
+    if (delim != string::npos && delim > 0)
+      make_dir(export_cache_dir.substr(0, delim));
+    if (make_dir(export_cache_dir))
+      write_file_atomically(export_cache_file_name(key), output);
+  }
+
+
+  bool module_export_collector(CompilationContext & ctx, int line, int col, const char * module_name) // nullptr for roottable
+  {
+    // root table depends only on csq, relative names of modules are resolved from the directory of the analyzed file
+    string moduleNameKey = module_name ? ctx.fileDir + "#" + module_name : string("#");
+
+    {
+      std::unique_lock<std::mutex> lock(modules_mutex);
+      collected_cv.wait(lock, [&]() { return collecting_keys.find(moduleNameKey) == collecting_keys.end(); });
+      auto foundModuleRoot = module_to_root.find(moduleNameKey);
+      if (foundModuleRoot != module_to_root.end())
+      {
+        use_root_table(foundModuleRoot->second, module_name != nullptr);
+        return true;
+      }
+
+      collecting_keys.insert(moduleNameKey);
+    }
+
+    // failed collection is not cached, waiting threads try it again and report their errors
+    struct CollectingGuard
+    {
+      const string & key;
+      ~CollectingGuard()
+      {
+        {
+          std::lock_guard<std::mutex> lock(modules_mutex);
+          collecting_keys.erase(key);
+        }
+        collected_cv.notify_all();
+      }
+    } collectingGuard = { moduleNameKey };
+
+    if (module_name && strchr(module_name, '\"'))
+    {
+      ctx.error(ERROR_MODULE_NAME, "Export collector: Invalid module name.", line, col);
+      return false;
+    }
+
+    // exports of required modules depend on sources of the modules, they are collected by each run
+    string cacheKey = (export_cache_dir.empty() || module_name) ? string() : export_cache_key();
+    string output;
 
-    module_content.insert(make_pair(moduleNameKey, moduleContent));
-    module_to_root.insert(make_pair(moduleNameKey, moduleRoot));
+    ExportTable moduleContent;
+    shared_ptr<ExportTable> moduleRoot = make_shared<ExportTable>();
 
-    fclose(fout);
-    remove(outputFileName);
+    bool isError = false;
+    bool fromCache = !cacheKey.empty() && load_cached_exports(cacheKey, moduleContent, *moduleRoot, isError);
+    if (!fromCache)
+    {
+      if (!run_dump_script(ctx, line, col, module_name, output))
+        return false;
+
+      isError = parse_dump_output(output.c_str(), output.size(), module_name != nullptr, moduleContent, *moduleRoot);
+      if (!cacheKey.empty() && !isError)
+        store_cached_exports(cacheKey, output);
+    }
+
+    use_root_table(moduleRoot, module_name != nullptr);
+
+    {
+      std::lock_guard<std::mutex> lock(modules_mutex);
+      if (module_to_root.insert(make_pair(moduleNameKey, moduleRoot)).second)
+        cached_module_keys.push_back(moduleNameKey);
+      module_content.insert(make_pair(moduleNameKey, moduleContent));
+
+      while (max_cached_modules > 0 && cached_module_keys.size() > max_cached_modules)
+      {
+        module_content.erase(cached_module_keys.front());
+        module_to_root.erase(cached_module_keys.front());
+        cached_module_keys.pop_front();
+      }
+    }
 
-    if (isError && moduleContent.empty() && moduleRoot.empty())
+    if (isError && moduleContent.empty() && moduleRoot->empty())
     {
       CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
-      ctx.error(74, (string("Export collector: failed to require '") +
+      ctx.error(ERROR_REQUIRE, (string("Export collector: failed to require '") +
         (module_name ? module_name : "<null>") + "'.").c_str(), line, col);
       return false;
     }
@@ -198,13 +372,72 @@ namespace moduleexports
   }
 
 
+  static std::thread prefetch_thread;
+  static string root_table_file_name; // the root table is collected for files like this one
+
+  static shared_ptr<const ExportTable> collect_root_table_silently(const string & file_name)
+  {
+    // errors are reported by the files which use the table, failed collection is not cached and is repeated for them
+    FileReport discarded;
+    FileReport * prevReport = CompilationContext::activeReport;
+    CompilationContext::activeReport = &discarded;
+    shared_ptr<const ExportTable> prevTable = root_table;
+
+    shared_ptr<const ExportTable> table;
+    {
+      CompilationContext ctx;
+      ctx.setFileName(file_name);
+      if (module_export_collector(ctx, 0, 0, nullptr))
+        table = root_table;
+    }
+
+    CompilationContext::activeReport = prevReport;
+    root_table = prevTable;
+    return table;
+  }
+
+
+  string root_table_digest()
+  {
+    ContentHash h;
+    h.add(csq_identity());
+
+    shared_ptr<const ExportTable> table = collect_root_table_silently(root_table_file_name);
+    h.add(uint64_t(table ? table->size() + 1 : 0));
+    if (table)
+      for (auto && ident : *table)
+      {
+        h.add(ident.first);
+        h.add(uint64_t(ident.second.size()));
+        for (const string & child : ident.second)
+          h.add(child);
+      }
+
+    return h.hex();
+  }
+
+
+  void start_root_table_prefetch(const string & file_name)
+  {
+    wait_root_table_prefetch();
+    root_table_file_name = file_name;
+    prefetch_thread = std::thread([file_name]() { collect_root_table_silently(file_name); });
+  }
+
+
+  void wait_root_table_prefetch()
+  {
+    if (prefetch_thread.joinable())
+      prefetch_thread.join();
+  }
+
+
   bool is_identifier_present_in_root(const char * name)
   {
     if (!name || !name[0])
       return false;
 
-    auto it = root.find(name);
-    return (it != root.end());
+    return root_table && root_table->find(name) != root_table->end();
   }
 
 
@@ -213,6 +446,7 @@ namespace moduleexports
     if (!module_name || !module_name[0] || !ident_name || !ident_name[0])
       return false;
 
+    std::lock_guard<std::mutex> lock(modules_mutex);
     auto it = module_content.find(module_name);
     if (it == module_content.end())
       return false;
@@ -224,4 +458,17 @@ namespace moduleexports
     return true;
   }
 
+
+  void clear_cache()
+  {
+    std::lock_guard<std::mutex> lock(modules_mutex);
+    module_content.clear();
+    module_to_root.clear();
+    cached_module_keys.clear();
+    root_table.reset();
+
+    std::lock_guard<std::mutex> identityLock(identity_mutex); // csq may be updated
+    identity.clear();
+  }
+
 } // namespace
@@ -5,8 +5,26 @@
 
 namespace moduleexports
 {
+  // error ids of the export collector, they depend on environment rather than on the analyzed file
+  enum
+  {
+    ERROR_TEMP_FILE = 70,
+    ERROR_MODULE_NAME = 71,
+    ERROR_CSQ_NOT_FOUND = 72,
+    ERROR_MODULE_EXECUTION = 73,
+    ERROR_REQUIRE = 74,
+  };
+
   extern std::string csq_exe;
+  extern std::string export_cache_dir; // collected exports are kept in files between runs, empty - disabled
+  extern size_t max_cached_modules; // 0 - unlimited, otherwise oldest collected exports are dropped
 
   bool module_export_collector(CompilationContext & ctx, int line, int col, const char * module_name = nullptr); // nullptr for roottable
   bool is_identifier_present_in_root(const char * name);
+  // root table is collected on background thread for files like file_name, module_export_collector() waits for it
+  void start_root_table_prefetch(const std::string & file_name);
+  void wait_root_table_prefetch();
+  // hash of csq and of the root table it dumps, the table is collected now if it is not collected yet
+  std::string root_table_digest();
+  void clear_cache(); // forget collected exports, they will be collected again on demand
 }
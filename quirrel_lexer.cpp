@@ -27,17 +27,33 @@ const char * token_strings[] =
 #undef TOKEN_TYPE
 
 
-void Lexer::initializeTokenMaps()
+static bool is_ident_token_string(const char * str)
 {
-  if (!tokenIdentStringToType.empty())
-    return;
+  return (str[0] >= 'a' && str[0] <= 'z') || str[0] == '_';
+}
 
+static std::map<std::string, TokenType> build_token_ident_map()
+{
+  std::map<std::string, TokenType> res;
   for (int i = 0; i < int(TOKEN_TYPE_COUNT); i++)
-    if ((token_strings[i][0] >= 'a' && token_strings[i][0] <= 'z') || token_strings[i][0] == '_')
-    {
-      tokenIdentStringToType.insert(std::make_pair<std::string, TokenType>(token_strings[i], TokenType(i)));
+    if (is_ident_token_string(token_strings[i]))
+      res.insert(std::make_pair<std::string, TokenType>(token_strings[i], TokenType(i)));
+
+  return res;
+}
+
+static const std::map<std::string, TokenType> & token_ident_map()
+{
+  static const std::map<std::string, TokenType> tokenIdentMap = build_token_ident_map();
+  return tokenIdentMap;
+}
+
+
+void Lexer::initializeTokenMaps()
+{
+  for (int i = 0; i < int(TOKEN_TYPE_COUNT); i++)
+    if (is_ident_token_string(token_strings[i]))
       ctx.stringList.insert(token_strings[i]);
-    }
 }
 
 
@@ -90,7 +106,8 @@ bool Lexer::isContinueOfIdent(int c)
 Lexer::Lexer(CompilationContext & compiler_context) :
   ctx(compiler_context),
   isReaderMacro(false),
-  s(compiler_context.code)
+  s(compiler_context.code),
+  tokenIdentStringToType(token_ident_map())
 {
   initializeTokenMaps();
 }
@@ -98,8 +115,10 @@ Lexer::Lexer(CompilationContext & compiler_context) :
 Lexer::Lexer(CompilationContext & compiler_context, const std::string & code) :
   ctx(compiler_context),
   isReaderMacro(false),
-  s(code)
+  s(macroCode),
+  tokenIdentStringToType(token_ident_map())
 {
+  macroCode.view(code);
   initializeTokenMaps();
 }
 
@@ -401,7 +420,7 @@ void Lexer::onCompilerDirective(const std::string & directive)
 bool Lexer::process()
 {
   tokens.clear();
-  index = is_utf8_bom(s.c_str(), 0) ? 3 : 0;
+  index = s.hasUtf8Bom() ? 3 : 0;
 
   curLine = 1;
   curColumn = 1;
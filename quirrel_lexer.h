@@ -135,8 +135,9 @@ struct Token
 
 class Lexer
 {
-  const std::string & s; // code
-  std::map<std::string, TokenType> tokenIdentStringToType;
+  SourceText macroCode; // code of reader macro, viewed
+  const SourceText & s; // code
+  const std::map<std::string, TokenType> & tokenIdentStringToType; // shared by all lexers, built once
 
   int curLine;
   int curColumn;
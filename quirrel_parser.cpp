@@ -9,7 +9,7 @@ const char * node_type_names[] =
 };
 #undef NODE_TYPE
 
-static Token emptyToken;
+static thread_local Token emptyToken;
 
 struct Parser
 {
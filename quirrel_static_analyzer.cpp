@@ -8,26 +8,49 @@
 #include <vector>
 #include <set>
 #include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
 
 #include <fstream>
 #include <streambuf>
 
 #include <string.h>
 #include <limits.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#  include <io.h>
+#  include <fcntl.h>
+#endif
 
 #include "keyValueFile/keyValueFile.h"
 
 #include "quirrel_parser.h"
 #include "module_exports.h"
 #include "json_output.h"
+#include "worker_pool.h"
+#include "analyzer_options.h"
+#include "analyzer_server.h"
+#include "source_job.h"
+#include "stream_frames.h"
+#include "result_cache.h"
+#include "remote_cache.h"
+#include "content_hash.h"
+#include "dir_walker.h"
+#include "file_watcher.h"
+#include "shards.h"
+#include "job_schedule.h"
+#include "run_journal.h"
+#include "distributed.h"
+#include "analyzer_build_id.h"
 
 
 using namespace std;
 using namespace sqimportparser;
 
 
-static bool variable_presense_check = true;
-
 struct AnalyzerMessage
 {
   int intId;
@@ -112,20 +135,26 @@ bool is_bool_result(TokenType type)
 
 namespace settings
 {
-  string cur_config_file_name = "?";
-  bool cur_config_file_failed = false;
-  vector<string> forbidden_function;
-  vector<string> format_function_name;
-  vector<string> function_can_return_null;
-  vector<string> function_calls_lambda_inplace;
-  vector<string> std_identifier;
-  vector<string> std_function;
-  vector<string> function_result_must_be_utilized;
-  vector<string> function_can_return_string;
-  vector<string> function_should_return_bool_prefix;
-  vector<string> function_should_return_something_prefix;
-  vector<string> function_forbidden_parent_dir;
-  vector<string> function_modifies_object;
+  // each worker thread keeps its own copy of current settings
+  thread_local string cur_config_file_name = "?";
+  thread_local bool cur_config_file_failed = false;
+  thread_local vector<string> forbidden_function;
+  thread_local vector<string> format_function_name;
+  thread_local vector<string> function_can_return_null;
+  thread_local vector<string> function_calls_lambda_inplace;
+  thread_local vector<string> std_identifier;
+  thread_local vector<string> std_function;
+  thread_local vector<string> function_result_must_be_utilized;
+  thread_local vector<string> function_can_return_string;
+  thread_local vector<string> function_should_return_bool_prefix;
+  thread_local vector<string> function_should_return_something_prefix;
+  thread_local vector<string> function_forbidden_parent_dir;
+  thread_local vector<string> function_modifies_object;
+
+  // messages printed while loading each config, published where a serial run would (re)load it
+  map<string, FileReport> config_load_reports;
+  std::mutex config_load_reports_mutex;
+  string published_config_file_name = "?";
 
   void reset()
   {
@@ -274,7 +303,7 @@ namespace settings
   void print_error_func(const char * msg)
   {
     CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
-    fprintf(out_stream, "%s\n", msg);
+    CompilationContext::printText((string(msg) + "\n").c_str());
   }
 
   bool append_from_file(const char * filename)
@@ -370,8 +399,8 @@ namespace settings
     if (!initial_file_name)
       return string("");
 
-    static string cachedDir = "?";
-    static string cachedFileName = "?";
+    static thread_local string cachedDir = "?";
+    static thread_local string cachedFileName = "?";
     const char * slash1 = strrchr(initial_file_name, '\\');
     const char * slash2 = strrchr(initial_file_name, '/');
     const char * slash = slash1 > slash2 ? slash1 : slash2;
@@ -399,6 +428,67 @@ namespace settings
     cachedFileName = fileName;
     return fileName;
   }
+
+
+  // returns false if config cannot be loaded
+  bool switch_config(const string & config_file_name)
+  {
+    FileReport * fileReport = CompilationContext::activeReport;
+    if (fileReport)
+    {
+      ReportedEvent ev;
+      ev.type = RE_CONFIG;
+      ev.text = config_file_name;
+      CompilationContext::emit(ev);
+    }
+
+    if (config_file_name == cur_config_file_name)
+      return !cur_config_file_failed;
+
+    FileReport loadReport;
+    if (fileReport)
+      CompilationContext::activeReport = &loadReport;
+
+    reset();
+    cur_config_file_name = config_file_name;
+    cur_config_file_failed = false;
+    if (!config_file_name.empty())
+      append_from_file(config_file_name.c_str());
+
+    if (fileReport)
+    {
+      CompilationContext::activeReport = fileReport;
+      std::lock_guard<std::mutex> lock(config_load_reports_mutex);
+      config_load_reports.insert(make_pair(config_file_name, loadReport));
+    }
+
+    return !cur_config_file_failed;
+  }
+
+
+  void clear_cache()
+  {
+    cur_config_file_name = "?";
+    cur_config_file_failed = false;
+    published_config_file_name = "?";
+    std::lock_guard<std::mutex> lock(config_load_reports_mutex);
+    config_load_reports.clear();
+  }
+
+
+  void publish_config_switch(const string & config_file_name)
+  {
+    if (config_file_name == published_config_file_name)
+      return;
+
+    published_config_file_name = config_file_name;
+
+    std::lock_guard<std::mutex> lock(config_load_reports_mutex);
+    auto it = config_load_reports.find(config_file_name);
+    if (it != config_load_reports.end())
+      for (const ReportedEvent & ev : it->second.events)
+        CompilationContext::publish(ev);
+  }
 };
 
 
@@ -413,10 +503,10 @@ namespace trusted
     TR_GLOBAL,
   };
 
-  bool trusted_identifiers;
-  map<string, set<string> > trusted_consts;
-  map<string, set<string> > trusted_locals;
-  map<string, set<string> > trusted_globals;
+  thread_local bool trusted_identifiers;
+  thread_local map<string, set<string> > trusted_consts;
+  thread_local map<string, set<string> > trusted_locals;
+  thread_local map<string, set<string> > trusted_globals;
 
   void clear()
   {
@@ -461,6 +551,18 @@ namespace trusted
       it->second.insert(child);
   }
 
+  // line in format 'parent' or 'parent.child'
+  void add_line(TrustedContext ident_context, const string & line)
+  {
+    const char * dot = strchr(line.c_str(), '.');
+    string parent(line.c_str(), dot ? dot - line.c_str() : line.length());
+    string child;
+    if (dot)
+      child = string(dot + 1);
+
+    add(ident_context, parent, child);
+  }
+
   TrustedContext find(const string & parent, const string & child)
   {
     {
@@ -511,7 +613,31 @@ struct IdentTree
 IdentTree ident_root; // root
 set <string> ever_declared;
 
-vector<pair<Node *, pair<Node *, bool> > > nearest_assignments; // name { expression, is_optional }
+
+static thread_local SourceJob * active_job = nullptr;
+static set<string> published_declared; // ever_declared must stay unchanged while workers are running
+// --shard: declarations of other shards' files before the file, one set for each occurrence of the file in the list
+static map<string, deque<set<string> > > declared_before_file;
+
+// --watch: declarations of each published file, a re-analyzed file sees only current declarations of files before it
+struct FileDeclarations
+{
+  set<string> predefined; // ever_declared after the predefinition pass
+  vector<string> order; // files in the order of the first publish
+  map<string, set<string> > declared;
+};
+
+static FileDeclarations * watched_declarations = nullptr;
+
+
+static bool is_ever_declared(const string & name)
+{
+  if (ever_declared.find(name) != ever_declared.end())
+    return true;
+
+  return active_job && active_job->declared.find(name) != active_job->declared.end();
+}
+
 
 static void collect_ever_declared(Lexer & lexer)
 {
@@ -530,7 +656,10 @@ static void collect_ever_declared(Lexer & lexer)
     {
       if (prev != TK_LOCAL && prev2 != TK_LOCAL && prev != TK_DOT && prev != TK_LPAREN && prev != TK_COMMA)
       {
-        ever_declared.insert(std::string(tokens[i].u.s));
+        if (active_job)
+          active_job->declared.insert(std::string(tokens[i].u.s));
+        else
+          ever_declared.insert(std::string(tokens[i].u.s));
       }
     }
   }
@@ -592,6 +721,61 @@ static void set_sub_tree_by_path(IdentTree * tree, IdentTree * subTree, vector<s
 }
 
 
+// Top level declarations of a predefinition file. Workers record them instead of modifying ident_root,
+// then they are applied in the order of files, so the result is the same as for the serial pass.
+struct IdentTreeFragment
+{
+  struct Item
+  {
+    vector<string> path;
+    IdentTree * subTree;
+    bool isGlobalEnum; // path[0] is the name of enum
+  };
+
+  vector<Item> items;
+};
+
+static thread_local IdentTreeFragment * active_fragment = nullptr;
+
+
+static void add_sub_tree_by_path(IdentTree * tree, IdentTree * subTree, vector<string> & path)
+{
+  if (active_fragment && tree == &ident_root)
+  {
+    IdentTreeFragment::Item item = { path, subTree, false };
+    active_fragment->items.push_back(item);
+  }
+  else
+    set_sub_tree_by_path(tree, subTree, path);
+}
+
+
+static void add_global_enum(const char * name)
+{
+  if (active_fragment)
+  {
+    IdentTreeFragment::Item item = { vector<string>(1, string(name)), nullptr, true };
+    active_fragment->items.push_back(item);
+  }
+  else
+    ident_root.children.insert(make_pair(string(name), nullptr));
+}
+
+
+static void apply_ident_tree_fragment(IdentTreeFragment & fragment)
+{
+  for (IdentTreeFragment::Item & item : fragment.items)
+  {
+    if (item.isGlobalEnum)
+      ident_root.children.insert(make_pair(item.path[0], nullptr));
+    else
+      set_sub_tree_by_path(&ident_root, item.subTree, item.path);
+  }
+
+  fragment.items.clear();
+}
+
+
 static bool global_collect_tree(Node * node, IdentTree * tree)
 {
   if (!node || !tree)
@@ -606,7 +790,7 @@ static bool global_collect_tree(Node * node, IdentTree * tree)
       delete subTree;
       subTree = nullptr;
     }
-    set_sub_tree_by_path(tree, subTree, path);
+    add_sub_tree_by_path(tree, subTree, path);
   }
   else if (node->nodeType == PNT_STATEMENT_LIST) // root
   {
@@ -626,18 +810,18 @@ static bool global_collect_tree(Node * node, IdentTree * tree)
           delete subTree;
           subTree = nullptr;
         }
-        set_sub_tree_by_path(tree, subTree, path);
+        add_sub_tree_by_path(tree, subTree, path);
       }
 
       if (cur->nodeType == PNT_FUNCTION)
       {
         vector<string> path = node_to_path(cur->children[0]);
-        set_sub_tree_by_path(tree, nullptr, path);
+        add_sub_tree_by_path(tree, nullptr, path);
       }
 
       if (cur->nodeType == PNT_GLOBAL_ENUM)
       {
-        ident_root.children.insert(make_pair(string(cur->children[0]->tok.u.s), nullptr));
+        add_global_enum(cur->children[0]->tok.u.s);
       }
 
       if (cur->nodeType == PNT_IF_ELSE)
@@ -659,7 +843,7 @@ static bool global_collect_tree(Node * node, IdentTree * tree)
           vector<string> path = node_to_path(nameNode);
           IdentTree * subTree = new IdentTree;
           global_collect_tree(classNode, subTree);
-          set_sub_tree_by_path(tree, subTree, path);
+          add_sub_tree_by_path(tree, subTree, path);
         }
       }
     }
@@ -688,7 +872,7 @@ static bool global_collect_tree(Node * node, IdentTree * tree)
             delete subTree;
             subTree = nullptr;
           }
-          set_sub_tree_by_path(tree, subTree, path);
+          add_sub_tree_by_path(tree, subTree, path);
         }
     }
     return true;
@@ -925,6 +1109,8 @@ class Analyzer
 
   set<const char *> requiredModuleNames;
 
+  vector<pair<Node *, pair<Node *, bool> > > nearest_assignments; // name { expression, is_optional }
+
 
   bool isNodeEquals(Node * a, Node * b)
   {
@@ -1496,6 +1682,57 @@ public:
   {
     for (int i = 0; i < 16; i++)
       nodePath.push_back(nullptr);
+
+    timeBudgetMs = 0;
+    overBudget = false;
+    skippedRules = 0;
+  }
+
+
+  // Rules which can be quadratic on pathological code, they are skipped when the file is over its time budget
+  enum ExpensiveRules
+  {
+    ER_SIMILAR_CODE = 1, // duplicate and similar functions and assigned expressions, siblings are compared pairwise
+    ER_EXPRESSION_CHAINS = 2, // operands of long operator chains are compared with each other and with assignments
+  };
+
+  int timeBudgetMs;
+  std::chrono::steady_clock::time_point deadline;
+  bool overBudget;
+  int skippedRules;
+
+  void setTimeBudget(int budget_ms, std::chrono::steady_clock::time_point start)
+  {
+    timeBudgetMs = budget_ms;
+    deadline = start + std::chrono::milliseconds(budget_ms);
+  }
+
+  bool isExpensiveRuleAllowed(int rule)
+  {
+    if (timeBudgetMs <= 0)
+      return true;
+
+    if (!overBudget && std::chrono::steady_clock::now() > deadline)
+      overBudget = true;
+
+    if (overBudget)
+      skippedRules |= rule;
+
+    return !overBudget;
+  }
+
+  void reportSkippedRules(Node * root)
+  {
+    if (!skippedRules)
+      return;
+
+    string rules;
+    if (skippedRules & ER_SIMILAR_CODE)
+      rules += "duplicate-function, similar-function, duplicate-assigned-expr, similar-assigned-expr";
+    if (skippedRules & ER_EXPRESSION_CHAINS)
+      rules += string(rules.empty() ? "" : ", ") + "copy-of-expression, always-true-or-false, plus-string";
+
+    ctx.warning("time-budget-exceeded", root->tok, to_string(timeBudgetMs).c_str(), rules.c_str());
   }
 
 
@@ -2736,7 +2973,8 @@ public:
     }
 
 
-    if (node->nodeType == PNT_BINARY_OP && (node->tok.type == TK_OR || node->tok.type == TK_AND || node->tok.type == TK_BITOR))
+    if (node->nodeType == PNT_BINARY_OP && (node->tok.type == TK_OR || node->tok.type == TK_AND || node->tok.type == TK_BITOR) &&
+      isExpensiveRuleAllowed(ER_EXPRESSION_CHAINS))
     {
       Node * cmp = node;
       while (cmp->children[0]->tok.type == node->tok.type && cmp->children[0]->nodeType == node->nodeType)
@@ -2755,7 +2993,8 @@ public:
       checkFunctionCallFormatArguments(node);
 
 
-    if (node->nodeType == PNT_BINARY_OP && (node->tok.type == TK_OR || node->tok.type == TK_AND))
+    if (node->nodeType == PNT_BINARY_OP && (node->tok.type == TK_OR || node->tok.type == TK_AND) &&
+      isExpensiveRuleAllowed(ER_EXPRESSION_CHAINS))
     {
       Node * left = node->children[0];
       Node * right = node->children[1];
@@ -3119,7 +3358,8 @@ public:
     }
 
 
-    if (node->nodeType == PNT_BINARY_OP && (node->tok.type == TK_PLUS || node->tok.type == TK_PLUSEQ))
+    if (node->nodeType == PNT_BINARY_OP && (node->tok.type == TK_PLUS || node->tok.type == TK_PLUSEQ) &&
+      isExpensiveRuleAllowed(ER_EXPRESSION_CHAINS))
     {
       Node * left = tryReplaceVar(node->children[0], true);
       Node * right = tryReplaceVar(node->children[1], true);
@@ -3162,7 +3402,7 @@ public:
       node->nodeType == PNT_STATEMENT_LIST)
     {
       size_t start = (node->nodeType == PNT_CLASS || node->nodeType == PNT_LOCAL_CLASS) ? 3 : 0;
-      for (size_t i = start; i < node->children.size(); i++)
+      for (size_t i = start; i < node->children.size() && isExpensiveRuleAllowed(ER_SIMILAR_CODE); i++)
         if (node->children[i])
         {
           Node * functionA = extractFunction(node->children[i]);
@@ -3208,7 +3448,7 @@ public:
 
     if (node->nodeType == PNT_STATEMENT_LIST)
     {
-      for (size_t i = 0; i < node->children.size(); i++)
+      for (size_t i = 0; i < node->children.size() && isExpensiveRuleAllowed(ER_SIMILAR_CODE); i++)
         if (node->children[i])
         {
           Node * expressionA = extractAssignedExpression(node->children[i]);
@@ -3528,9 +3768,20 @@ public:
   {
     while (!localIdentifiers.empty() && int(localIdentifiers.size()) > scope_depth)
     {
+      // scope is ordered by addresses of names, report in the order of declarations to keep output stable
+      vector<IdentifierStruct *> scopeIdents;
       for (auto & it : localIdentifiers.back())
+        scopeIdents.push_back(&it.second);
+
+      std::stable_sort(scopeIdents.begin(), scopeIdents.end(), [this](const IdentifierStruct * a, const IdentifierStruct * b)
+      {
+        int cmp = cmpTokenPos(a->declaredAt, b->declaredAt);
+        return cmp != 0 ? cmp < 0 : strcmp(a->namePtr, b->namePtr) < 0;
+      });
+
+      for (IdentifierStruct * identPtr : scopeIdents)
       {
-        IdentifierStruct & ident = it.second;
+        IdentifierStruct & ident = *identPtr;
         if (!ident.usedAt && ident.declaredAt)
           if (ident.declContext == DC_LOOP_VARIABLE)
           {
@@ -3538,7 +3789,7 @@ public:
 
             if (ident.loopNode)
               for (auto & it2 : localIdentifiers.back())
-                if (&it != &it2 && ident.loopNode == it2.second.loopNode && it2.second.usedAt)
+                if (&ident != &it2.second && ident.loopNode == it2.second.loopNode && it2.second.usedAt)
                 {
                   ignore = true; // other variable of this loop is used
                   break;
@@ -3552,9 +3803,9 @@ public:
           }
       }
 
-      for (auto & it : localIdentifiers.back())
+      for (IdentifierStruct * identPtr : scopeIdents)
       {
-        IdentifierStruct & ident = it.second;
+        IdentifierStruct & ident = *identPtr;
         if (!ident.usedAt && ident.declaredAt)
           if (ident.declContext == DC_LOCAL_VARIABLE || ident.declContext == DC_ENUM_NAME ||
             ident.declContext == DC_GLOBAL_ENUM_NAME || ident.declContext == DC_LOCAL_FUNCTION_NAME)
@@ -3577,6 +3828,17 @@ public:
   }
 
 
+  void warnNeverDeclared(const char * text_id, const Token & tok)
+  {
+    FileReport * report = CompilationContext::activeReport;
+    size_t eventsCount = report ? report->events.size() : 0;
+    ctx.warning(text_id, tok, tok.u.s);
+
+    // files published before this one may declare it, checked on publish
+    if (report && report->events.size() > eventsCount)
+      report->events.back().requiresUndeclared = tok.u.s;
+  }
+
   void checkDeclared(Node * node, Node * child_node, bool inside_static, int from_scope)
   {
     if (!node || node->nodeType != PNT_IDENTIFIER)
@@ -3598,18 +3860,17 @@ public:
         {
           ctx.warning("undefined-const", node->tok, node->tok.u.s);
         }
-        else if (!ctx.isWarningSuppressed("const-never-declared") &&
-          ever_declared.find(std::string(node->tok.u.s)) == ever_declared.end())
+        else if (!ctx.isWarningSuppressed("const-never-declared") && !is_ever_declared(node->tok.u.s))
         {
-          ctx.warning("const-never-declared", node->tok, node->tok.u.s);
+          warnNeverDeclared("const-never-declared", node->tok);
         }
       }
       else
       {
         if (!ctx.isWarningSuppressed("undefined-variable"))
           ctx.warning("undefined-variable", node->tok, node->tok.u.s);
-        else if (ever_declared.find(std::string(node->tok.u.s)) == ever_declared.end())
-          ctx.warning("never-declared", node->tok, node->tok.u.s);
+        else if (!is_ever_declared(node->tok.u.s))
+          warnNeverDeclared("never-declared", node->tok);
       }
     }
 
@@ -4095,9 +4356,40 @@ void print_usage()
   fprintf(out_stream, "  quirrel_static_analyzer [-wNNN] --files:<files-list.txt>\n\n");
   fprintf(out_stream, "  --files:<files-list.txt> - process multiple files. <files-list.txt> contains file names, one name per line.\n");
   fprintf(out_stream, "  --predefinition-files:<files-list.txt> - this list used to collect defined classed and tables.\n");
+  fprintf(out_stream, "  --stream:<file> - process sources from stream file, '-' for stdin. Binary format is described in stream_frames.h.\n");
+  fprintf(out_stream, "  --dir:<path> - process all .nut files in directory <path> and its subdirectories.\n");
+  fprintf(out_stream, "  --include:<glob> - process only files matching <glob> in --dir, default is '*.nut'.\n");
+  fprintf(out_stream, "  --exclude-dir:<glob> - skip subdirectories of --dir matching <glob> (like dirs_to_skip of .dreyconfig).\n");
+  fprintf(out_stream, "  --exclude-file:<glob> - skip files of --dir matching <glob> (like files_to_skip of .dreyconfig).\n");
+  fprintf(out_stream, "  --shard:<i>/<n> - analyze only i-th of n parts of input files (1 <= i <= n), parts are balanced by file size.\n"
+    "      Files of other parts are only scanned for declarations, so never-declared warnings are the same as in a single run.\n");
+  fprintf(out_stream, "  --merge-results:<file.json> - merge outputs of --message-output-file of shards (repeatable) instead of analysis.\n"
+    "      With the same --files lists as the shards, messages are in the order of a single run.\n");
+  fprintf(out_stream, "  --coordinator:[<address>:]<port> - hand out input files to worker processes connected to <port>, output is\n"
+    "      the same as with local analysis. Workers must be started with the same options and see the same files.\n"
+    "      Only local workers can connect unless <address> is given, e.g. 0.0.0.0 for all interfaces.\n");
+  fprintf(out_stream, "  --worker-timeout:<seconds> - files of a worker which sends no result for <seconds> are handed out to other\n"
+    "      workers, default is 600, 0 - wait forever.\n");
+  fprintf(out_stream, "  --worker:<host>:<port> - analyze files of coordinator on --jobs threads instead of input files.\n");
+  fprintf(out_stream, "  --batch - keep memory usage low for huge file lists: messages are not kept after output,\n"
+    "      repeated messages are hidden only within a file.\n");
+  fprintf(out_stream, "  --watch - keep running and analyze input files again when they are changed (Linux only).\n");
   fprintf(out_stream, "  --output:<output-file.txt> - write output to <output-file.txt> instead of stdout.\n");
   fprintf(out_stream, "  --output-mode:<1-line | 2-lines | full>  default is 'full'.\n");
   fprintf(out_stream, "  --csq-exe:<csq.exe with path> - set path to console squirrel executable file.\n");
+  fprintf(out_stream, "  --server - keep running and analyze code sent to stdin, see serve_session() for protocol.\n");
+  fprintf(out_stream, "  --server:<socket-path> - same as --server, but requests come from unix socket.\n");
+  fprintf(out_stream, "  --jobs:<N> - analyze files on N threads, 0 - use all CPU cores. Output is the same as with --jobs:1.\n");
+  fprintf(out_stream, "  --cache-dir:<dir> - reuse results of files analyzed with the same inputs before, results are stored in <dir>.\n"
+    "      Exports of modules collected by csq are also stored there, they are reused while csq and module sources are the same.\n");
+  fprintf(out_stream, "  --cache-url:<http://host:port/path> - share results with other machines through HTTP server (GET/PUT),\n"
+    "      see drey/result_cache_server.py. Can be used together with --cache-dir.\n");
+  fprintf(out_stream, "  --journal:<file> - record analyzed files to <file>, a run killed partway through is resumed with the same\n"
+    "      <file>: recorded files which were not changed are not analyzed again, their messages are shown from <file>.\n");
+  fprintf(out_stream, "  --file-time-budget:<ms> - skip expensive rules for files which are analyzed longer, the skipped rules are reported.\n");
+  fprintf(out_stream, "  --prefetch:<N> - read up to N input files ahead of the analysis, default is 2 * jobs, 0 - disabled.\n");
+  fprintf(out_stream, "  --prefetch-memory:<MB> - stop reading ahead while files read ahead take more memory, default is 64.\n");
+  fprintf(out_stream, "  --verbose - print scheduling of files between threads and remote cache statistics to stderr.\n");
   fprintf(out_stream, "  --warnings-list - show all supported warnings.\n");
   fprintf(out_stream,
     "  --tokens-output-file:<file-name> - print tokens to file (JSON), 'stdout' will be used if <file-name> is empty .\n");
@@ -4113,24 +4405,6 @@ void print_usage()
 }
 
 
-OutputMode str_to_output_mode(const char * str)
-{
-  if (!strcmp(str, "1-line"))
-    return OM_1_LINE;
-  else if (!strcmp(str, "2-lines"))
-    return OM_2_LINES;
-  else if (!strcmp(str, "full"))
-    return OM_FULL;
-
-  static bool errorShown = false;
-  if (!errorShown)
-    fprintf(out_stream, "WARNING: invalid output mode '%s', 'full' mode will be used.\n", str);
-  errorShown = true;
-
-  return OM_FULL;
-}
-
-
 static void error_cb(void * user_pointer, const char * message, int line, int column)
 {
   CompilationContext * ctx = (CompilationContext *)user_pointer;
@@ -4152,7 +4426,7 @@ bool process_import(CompilationContext & ctx)
   (void) importEndCol;
   (void) directives;
 
-  ImportParser::replaceImportBySpaces((char *)ctx.code.c_str(), (char *)importPtr, keepRanges);
+  ctx.code.mask(importPtr, keepRanges);
 
   return true;
 }
@@ -4162,66 +4436,55 @@ static std::set<int> used_args;
 static int argc__ = 0;
 static char ** argv__ = nullptr;
 
-int process_single_source(const string & file_name, const string & source_code, const string & sqconfig_file_name,
-  bool use_csq, bool collect_ident_tree)
-{
-  CompilationContext ctx;
 
-  if (collect_ident_tree)
-    use_csq = false;
+static int check_expectations(const string & file_name, bool res, bool expect_error, int expect_warning_number,
+  bool is_error, bool is_warning, const vector<int> & shown_warnings_and_errors)
+{
+  if (is_error || is_warning)
+    res = false;
 
-  bool inverseWarnings = false;
-  bool printAst = false;
+  if (expect_error && !is_error)
+  {
+    CompilationContext::globalError("Expected error.");
+    return 1;
+  }
 
-  bool printTokensToJson = false;
-  bool printAstToJson = false;
-  const char * tokensFileName = "";
-  const char * astFileName = "";
+  if (expect_warning_number && (!is_warning || shown_warnings_and_errors.size() != 1 ||
+    shown_warnings_and_errors[0] != expect_warning_number))
+  {
+    CompilationContext::globalError((string("Expected only one warning 'w") +
+      to_string(expect_warning_number) + "' in file '" + file_name + "'").c_str());
+    return 1;
+  }
 
-  for (int i = 1; i < argc__; i++)
+  if (expect_error || expect_warning_number)
   {
-    const char * arg = argv__[i];
-    bool used = true;
+    if (CompilationContext::getErrorLevel() != ERRORLEVEL_FATAL)
+      CompilationContext::clearErrorLevel();
 
-    {
-      // HACK: fix "duplucate-if-expression" -> "duplicate-if-expression", and support old config files
-      if (!strcmp("-duplucate-if-expression", arg))
-        arg = "-duplicate-if-expression";
-    }
+    return 0;
+  }
 
-    if (!strncmp(arg, "--tokens-output-file:", 21))
-    {
-      printTokensToJson = true;
-      tokensFileName = arg + 21;
-    }
-    else if (!strncmp(arg, "--ast-output-file:", 18))
-    {
-      printAstToJson = true;
-      astFileName = arg + 18;
-    }
-    else if (!strcmp(arg, "--inverse-warnings"))
-      inverseWarnings = true;
-    else if (!strncmp(arg, "--csq-exe:", 10))
-      moduleexports::csq_exe = arg + 10;
-//    else if (!strcmp(arg, "--print-ast"))  // deprecated
-//      printAst = true;
-    else if (!strncmp(arg, "--output-mode:", 14))
-      ctx.outputMode = str_to_output_mode(arg + 14);
-    else if (arg[0] == '-' && (toupper(arg[1]) == 'W') && isdigit(arg[2]))
-      ctx.suppressWaring(atoi(arg + 2));
-    else if (arg[0] == '-' && isalpha(arg[1]))
-      ctx.suppressWaring(arg + 1);
-    else
-      used = false;
+  return res ? 0 : 1;
+}
 
-    if (used)
-      used_args.insert(i);
-  }
+// loaded_code - file is already loaded by the caller, it is used instead of source_code
+int process_single_source(const AnalyzerOptions & options, const string & file_name, const string & source_code,
+  const string & sqconfig_file_name, bool use_csq, bool collect_ident_tree, const SourceText * loaded_code = nullptr)
+{
+  CompilationContext ctx;
 
-  if (inverseWarnings)
-    ctx.inverseWarningsSuppression();
+  if (collect_ident_tree)
+    use_csq = false;
+
+  bool printAst = false;
 
-  variable_presense_check = (!ctx.isWarningSuppressed("undefined-variable") ||
+  ctx.outputMode = options.outputMode;
+  ctx.setSuppressedWarnings(options.suppressedWarnings);
+  for (auto && argError : options.argumentErrors)
+    ctx.error(argError.first, argError.second.c_str(), 0, 0);
+
+  bool variable_presense_check = (!ctx.isWarningSuppressed("undefined-variable") ||
     !ctx.isWarningSuppressed("never-declared")) && use_csq;
 
   int expectWarningNumber = 0;
@@ -4234,36 +4497,29 @@ int process_single_source(const string & file_name, const string & source_code,
     return 1;
   }
 
-  if (source_code.empty())
+  if (loaded_code)
+  {
+    ctx.code.view(loaded_code->c_str(), loaded_code->length());
+  }
+  else if (source_code.empty())
   {
-    ifstream tmp(file_name);
-    if (tmp.fail())
+    if (!ctx.code.load(file_name))
     {
       CompilationContext::globalError((string("Cannot open file '") + file_name.c_str() + "'").c_str());
       return 1;
     }
-    ctx.code = string((std::istreambuf_iterator<char>(tmp)), std::istreambuf_iterator<char>());
   }
   else
   {
-    ctx.code = source_code;
+    ctx.code.view(source_code);
   }
 
   ctx.setFileName(file_name);
 
 
   string sqconfigFileName = sqconfig_file_name.empty() ? settings::search_sqconfig(file_name.c_str()) : sqconfig_file_name;
-  if (sqconfigFileName != settings::cur_config_file_name)
-  {
-    settings::reset();
-    if (!sqconfigFileName.empty())
-      if (!settings::append_from_file(sqconfigFileName.c_str()))
-        return 1;
-  }
-  else if (settings::cur_config_file_failed)
-  {
+  if (!settings::switch_config(sqconfigFileName))
     return 1;
-  }
 
 
   if (variable_presense_check)
@@ -4279,7 +4535,7 @@ int process_single_source(const string & file_name, const string & source_code,
   if (expectError || expectWarningNumber)
     ctx.clearSuppressedWarnings();
 
-  if ((printTokensToJson || printAstToJson) && !CompilationContext::redirectMessagesToJson)
+  if ((options.printTokensToJson || options.printAstToJson) && !CompilationContext::redirectMessagesToJson)
   {
     ctx.clearSuppressedWarnings();
     ctx.inverseWarningsSuppression();
@@ -4288,22 +4544,27 @@ int process_single_source(const string & file_name, const string & source_code,
   if (!process_import(ctx))
     return 1;
 
+  auto analysisStart = std::chrono::steady_clock::now(); // --file-time-budget does not include csq calls
+
   Lexer lex(ctx);
 
   bool res = true;
   res = res && lex.process();
 
-  if (printTokensToJson)
-    res &= tokens_to_json(tokensFileName, lex);
+  if (active_job)
+    active_job->tokenCount = int(lex.tokens.size());
+
+  if (options.printTokensToJson)
+    res &= tokens_to_json(options.tokensFileName.c_str(), lex);
 
 
   if (res)
   {
     Node * root = sq3_parse(lex); // do not delete, will be destroyed in ~CompilationContext()
 
-    if (printAstToJson)
+    if (options.printAstToJson)
     {
-      res &= ast_to_json(astFileName, root);
+      res &= ast_to_json(options.astFileName.c_str(), root);
       res &= !ctx.isError;
     }
 
@@ -4325,6 +4586,7 @@ int process_single_source(const string & file_name, const string & source_code,
       else
       {
         Analyzer analyzer(lex);
+        analyzer.setTimeBudget(options.fileTimeBudgetMs, analysisStart);
 
         if (root)
         {
@@ -4332,109 +4594,1348 @@ int process_single_source(const string & file_name, const string & source_code,
           analyzer.collectGlobalTables(root);
           analyzer.check(root);
           analyzer.checkVariables(root, 0, INT_MAX / 2, false, false, false, false, 1, false);
+          analyzer.reportSkippedRules(root);
         }
       }
     }
   }
 
-  if (ctx.isError || ctx.isWarning)
-    res = false;
+  if (active_job)
+  {
+    // warnings of this file can be deduplicated against other files, expectations are checked on publish
+    active_job->analysisOk = res;
+    active_job->expectError = expectError;
+    active_job->expectWarningNumber = expectWarningNumber;
+    active_job->isError = ctx.isError;
+    return -1;
+  }
+
+  return check_expectations(ctx.fileName, res, expectError, expectWarningNumber, ctx.isError, ctx.isWarning,
+    ctx.shownWarningsAndErrors);
+}
+
+
+static void analyze_source_job(const AnalyzerOptions & options, SourceJob & job, const string & source_code = string(),
+  const string & sqconfig_file_name = string(), const SourceText * loaded_code = nullptr)
+{
+  active_job = &job;
+  CompilationContext::activeReport = &job.report;
+  job.result = process_single_source(options, job.fileName, source_code, sqconfig_file_name, true, false, loaded_code);
+  CompilationContext::activeReport = nullptr;
+  active_job = nullptr;
+}
 
-  if (expectError && !ctx.isError)
+
+static int publish_source_job(SourceJob & job)
+{
+  auto before = declared_before_file.find(job.fileName);
+  if (before != declared_before_file.end() && !before->second.empty())
   {
-    CompilationContext::globalError("Expected error.");
-    return 1;
+    published_declared.insert(before->second.front().begin(), before->second.front().end());
+    before->second.pop_front();
   }
+  published_declared.insert(job.declared.begin(), job.declared.end());
 
-  if (expectWarningNumber && (!ctx.isWarning || ctx.shownWarningsAndErrors.size() != 1 ||
-    ctx.shownWarningsAndErrors[0] != expectWarningNumber))
+  if (watched_declarations)
   {
-    CompilationContext::globalError((string("Expected only one warning 'w") +
-      to_string(expectWarningNumber) + "' in file '" + ctx.fileName + "'").c_str());
-    return 1;
+    auto inserted = watched_declarations->declared.insert(make_pair(job.fileName, set<string>()));
+    if (inserted.second)
+      watched_declarations->order.push_back(job.fileName);
+    inserted.first->second = job.declared;
   }
 
-  if (expectError || expectWarningNumber)
+  bool isWarning = false;
+  vector<int> shownWarningsAndErrors;
+
+  for (const ReportedEvent & ev : job.report.events)
   {
-    if (CompilationContext::getErrorLevel() != ERRORLEVEL_FATAL)
-      CompilationContext::clearErrorLevel();
+    if (ev.type == RE_CONFIG)
+    {
+      settings::publish_config_switch(ev.text);
+      continue;
+    }
 
-    return 0;
+    if (!ev.requiresUndeclared.empty() && (ever_declared.find(ev.requiresUndeclared) != ever_declared.end() ||
+      published_declared.find(ev.requiresUndeclared) != published_declared.end()))
+    {
+      continue;
+    }
+
+    if (CompilationContext::publish(ev) && ev.type == RE_MESSAGE && !ev.hash.empty())
+    {
+      if (!ev.cm.isError)
+        isWarning = true;
+      shownWarningsAndErrors.push_back(ev.cm.intId);
+    }
   }
 
-  return res ? 0 : 1;
+  if (job.result >= 0)
+    return job.result;
+
+  return check_expectations(job.fileName, job.analysisOk, job.expectError, job.expectWarningNumber, job.isError,
+    isWarning, shownWarningsAndErrors);
 }
 
 
-const char * next_string(const char * p, string & out_str)
+// any change of the analyzer may change results, so each build uses its own cache entries
+static const char * analyzer_build_id = "quirrel_static_analyzer 1.0 " ANALYZER_SOURCES_HASH;
+
+
+static void hash_ident_tree(Sha1Hash & hash, const IdentTree & tree)
 {
-  out_str.clear();
-  out_str.reserve(100);
-  if (*p == 0x0d)
-    p++;
-  if (*p == 0x0a)
-    p++;
+  hash.add(uint64_t(tree.extends.size()));
+  for (const string & ext : tree.extends)
+    hash.add(ext);
 
-  while (*p)
+  hash.add(uint64_t(tree.children.size()));
+  for (auto && child : tree.children)
   {
-    if (*p == 0x0d || *p == 0x0a)
-      break;
-
-    out_str += *p;
-    p++;
+    hash.add(child.first);
+    hash.add(uint64_t(child.second != nullptr)); // global enums have no subtree
+    if (child.second)
+      hash_ident_tree(hash, *child.second);
   }
-  return p;
 }
 
-int process_stream_file(const char * stream_file_name)
-{
-  ifstream tmp(stream_file_name);
-  if (tmp.fail())
-  {
-    CompilationContext::globalError((string("Cannot open strem file '") + stream_file_name + "'").c_str());
-    return 1;
-  }
 
-  string stream((std::istreambuf_iterator<char>(tmp)), std::istreambuf_iterator<char>());
-  if (stream.empty())
-  {
-    CompilationContext::globalError((string("Stream file is empty '") + stream_file_name + "'").c_str());
-    return 1;
-  }
+// hashes config with all included files, includes are resolved relative to directory of config
+static void hash_config_file(Sha1Hash & hash, const string & file_name, int depth)
+{
+  if (file_name.empty() || depth > 16)
+    return;
 
-  int res = 0;
-  const char * p = stream.c_str();
+  ifstream tmp(file_name);
+  string text = tmp.fail() ? string() : string((std::istreambuf_iterator<char>(tmp)), std::istreambuf_iterator<char>());
+  hash.add(text);
 
-  string fileName;
-  trusted::TrustedContext trustedContext = trusted::TR_CONST;
-  string code;
-  string sqconfig;
-  bool insideCode = false;
+  size_t slash = file_name.find_last_of("/\\");
+  string dir = slash == string::npos ? string() : file_name.substr(0, slash + 1);
 
-  for (;;)
+  size_t pos = 0;
+  while (pos < text.length())
   {
-    string buf;
-    p = next_string(p, buf);
+    size_t eol = text.find('\n', pos);
+    if (eol == string::npos)
+      eol = text.length();
 
-    if (insideCode)
+    size_t b = text.find_first_not_of(" \t", pos);
+    if (b < eol && !text.compare(b, 7, "include") && b + 7 < eol && isspace((unsigned char)text[b + 7]))
     {
-      if (buf[0] != '#' || buf[1] != '#')
-      {
-        code += buf;
-        code += "\n";
-      }
-
-      if ((buf[0] == '#' && buf[1] == '#') || !*p) // end of code
+      size_t nameBegin = text.find_first_not_of(" \t", b + 7);
+      size_t nameEnd = text.find_last_not_of(" \t\r", eol - 1);
+      if (nameBegin < eol && nameEnd != string::npos && nameEnd >= nameBegin)
       {
-        res |= process_single_source(fileName, code, sqconfig, false, false);
-        insideCode = false;
+        string includeName = text.substr(nameBegin, nameEnd - nameBegin + 1);
+        hash.add(includeName);
+        hash_config_file(hash, dir + includeName, depth + 1);
       }
     }
 
-    if (!*p)
-      break;
+    pos = eol + 1;
+  }
+}
 
-    if (!strncmp(buf.c_str(), "###[FILE_NAME]", sizeof("###[FILE_NAME]") - 1))
+
+// undefined-variable and never-declared checks of the main pass use the root table dumped by csq
+static bool uses_csq_root_table(const AnalyzerOptions & options)
+{
+  CompilationContext ctx;
+  ctx.setSuppressedWarnings(options.suppressedWarnings);
+  return !ctx.isWarningSuppressed("undefined-variable") || !ctx.isWarningSuppressed("never-declared");
+}
+
+
+// csq dumps the root table while files are listed and the predefinition pass runs, analyzed files do not wait for it
+static void start_root_table_prefetch(const AnalyzerOptions & options, const vector<string> & file_list)
+{
+  if (!uses_csq_root_table(options))
+    return;
+
+  if (!file_list.empty())
+    moduleexports::start_root_table_prefetch(file_list[0]);
+  else if (!options.inputDirs.empty())
+    moduleexports::start_root_table_prefetch(join_path(options.inputDirs[0], "-"));
+}
+
+
+// declarations of a file as the analysis records them: collect_ever_declared() of a file without syntax errors
+static void collect_file_declarations(SourceJob & job)
+{
+  FileReport discarded;
+  CompilationContext::activeReport = &discarded;
+  active_job = &job;
+  {
+    CompilationContext ctx;
+    ctx.setFileName(job.fileName);
+    if (ctx.code.load(job.fileName) && process_import(ctx))
+    {
+      Lexer lex(ctx);
+      if (lex.process() && sq3_parse(lex) && !ctx.isError)
+        collect_ever_declared(lex);
+    }
+  }
+  active_job = nullptr;
+  CompilationContext::activeReport = nullptr;
+}
+
+
+// never-declared warnings of a file are resolved against declarations of all files before it (see
+// publish_source_job()), so files of other shards which precede files of this shard are scanned for declarations.
+// This way a shard reports the same warnings as a single run over all files, and --merge-results gives its output.
+static vector<string> select_shard_with_declarations(const AnalyzerOptions & options, const vector<string> & all_files)
+{
+  vector<size_t> shardIndices = select_shard_files(all_files, options.shardIndex, options.shardCount);
+  vector<string> shardFiles;
+  for (size_t i : shardIndices)
+    shardFiles.push_back(all_files[i]);
+
+  CompilationContext ctx;
+  ctx.setSuppressedWarnings(options.suppressedWarnings);
+  if (ctx.isWarningSuppressed("never-declared") && ctx.isWarningSuppressed("const-never-declared"))
+    return shardFiles;
+
+  // shard files are a subsequence of the input list, other files before the last shard file are scanned
+  vector<SourceJob> skipped;
+  vector<size_t> nextShardFile; // index in shardFiles of the first shard file after skipped file
+  for (size_t i = 0, j = 0; i < all_files.size() && j < shardIndices.size(); i++)
+  {
+    if (i == shardIndices[j])
+    {
+      j++;
+      continue;
+    }
+
+    skipped.push_back(SourceJob());
+    skipped.back().fileName = all_files[i];
+    nextShardFile.push_back(j);
+  }
+
+  // declarations before each shard file, in the order of shard files, so a file listed twice gets a set for each
+  vector<set<string> > declaredBefore(shardFiles.size());
+  run_ordered_jobs(skipped.size(), options.jobs,
+    [&](size_t i) { collect_file_declarations(skipped[i]); },
+    [&](size_t i)
+    {
+      declaredBefore[nextShardFile[i]].insert(skipped[i].declared.begin(), skipped[i].declared.end());
+      skipped[i].declared.clear();
+    });
+
+  for (size_t j = 0; j < shardFiles.size(); j++)
+    declared_before_file[shardFiles[j]].push_back(std::move(declaredBefore[j]));
+
+  return shardFiles;
+}
+
+
+// inputs shared by all files of the run: analyzer build, options, csq with its root table and results of
+// predefinition pass
+static string result_cache_inputs_digest(const AnalyzerOptions & options)
+{
+  Sha1Hash hash;
+  hash.add(string(analyzer_build_id));
+  hash.add(uint64_t(options.outputMode));
+  hash.add(options.suppressedWarnings.to_string());
+  for (auto && argError : options.argumentErrors)
+  {
+    hash.add(uint64_t(argError.first));
+    hash.add(argError.second);
+  }
+  hash.add(uint64_t(CompilationContext::redirectMessagesToJson != nullptr));
+  hash.add(uint64_t(CompilationContext::quietMessages));
+  hash.add(options.csqExe);
+  hash.add(uses_csq_root_table(options) ? moduleexports::root_table_digest() : string());
+
+  hash.add(uint64_t(ever_declared.size()));
+  for (const string & name : ever_declared)
+    hash.add(name);
+
+  hash_ident_tree(hash, ident_root);
+  return hash.hex();
+}
+
+
+// reading stage of the pipeline: file is read and its config is found ahead of the analysis,
+// returns the size of the read file
+static size_t read_source_job_input(SourceJob & job, bool prefault = false)
+{
+  std::shared_ptr<SourceText> source = std::make_shared<SourceText>();
+  if (source->load(job.fileName))
+  {
+    if (prefault)
+      source->prefault();
+    job.source = source;
+  }
+  job.sqconfig = settings::search_sqconfig(job.fileName.c_str());
+  return job.source ? job.source->length() : 0;
+}
+
+
+// key of all inputs of the analysis of a file for the result cache and the journal, job.source must be read
+static string source_job_key(const string & inputs_digest, const SourceJob & job)
+{
+  // file name is a part of the key: it is printed in messages and defines the root table of the module
+  Sha1Hash hash;
+  hash.add(inputs_digest);
+  hash.add(job.fileName);
+  hash.add(uint64_t(job.source->length()));
+  hash.add(job.source->c_str(), job.source->length());
+  hash.add(job.sqconfig);
+  hash_config_file(hash, job.sqconfig, 0);
+  return hash.hex();
+}
+
+
+// loaded report contains config switch, messages of config loading must be available on publish
+static void switch_config_of_loaded_job(const string & sqconfig)
+{
+  FileReport loadReport;
+  CompilationContext::activeReport = &loadReport;
+  settings::switch_config(sqconfig);
+  CompilationContext::activeReport = nullptr;
+}
+
+
+// --cache-url, results of all input files are looked up before the analysis
+static RemoteResultCache remote_cache;
+
+
+// local cache is checked first, results found in the remote cache are stored to the local one
+static bool load_cached_source_job(const AnalyzerOptions & options, const string & key, SourceJob & job)
+{
+  string sqconfig = job.sqconfig;
+  bool localCache = !options.cacheDir.empty();
+
+  if (localCache && resultcache::load(options.cacheDir, key, job))
+  {
+    switch_config_of_loaded_job(sqconfig);
+    return true;
+  }
+
+  if (remote_cache.load(key, job))
+  {
+    switch_config_of_loaded_job(sqconfig);
+    if (localCache)
+      resultcache::store(options.cacheDir, key, job);
+    return true;
+  }
+
+  return false;
+}
+
+
+static void store_cached_source_job(const AnalyzerOptions & options, const string & key, const SourceJob & job)
+{
+  if (!resultcache::is_cacheable(job))
+    return;
+
+  if (!options.cacheDir.empty())
+    resultcache::store(options.cacheDir, key, job);
+  remote_cache.store(key, job);
+}
+
+
+static void analyze_cached_source_job(const AnalyzerOptions & options, const string & key, SourceJob & job)
+{
+  if (load_cached_source_job(options, key, job))
+    return;
+
+  analyze_source_job(options, job, string(), job.sqconfig, job.source.get());
+  store_cached_source_job(options, key, job);
+}
+
+
+// Files with the same content, config and export context are analyzed once per run. Reports of the other
+// files are copies of the first report with the file name replaced. Content is hashed only for files whose
+// size, config and directory match another file, a file is analyzed again if its copy is not finished yet.
+class DuplicateFiles
+{
+  bool exportContextByDir;
+  std::mutex entriesMutex;
+  map<string, int> seenGroups; // number of files with the same groupKey()
+  map<string, std::shared_ptr<const SourceJob> > reports; // reusable reports by content key, without sources
+
+  string groupKey(const SourceJob & job) const
+  {
+    size_t slash = job.fileName.find_last_of("/\\");
+    string dir = exportContextByDir && slash != string::npos ? job.fileName.substr(0, slash) : string();
+    return to_string(job.source->length()) + "\n" + job.sqconfig + "\n" + dir;
+  }
+
+  static string contentKey(const SourceJob & job, const string & group_key)
+  {
+    ContentHash hash;
+    hash.add(group_key);
+    hash.add(job.source->c_str(), job.source->length());
+    return hash.hex();
+  }
+
+public:
+  DuplicateFiles(const AnalyzerOptions & options)
+  {
+    // without export tables of csq the analysis does not depend on the directory of file
+    int undefinedVariable = CompilationContext::findWarningId("undefined-variable");
+    int neverDeclared = CompilationContext::findWarningId("never-declared");
+    exportContextByDir = !options.suppressedWarnings.test(undefinedVariable) ||
+      !options.suppressedWarnings.test(neverDeclared);
+  }
+
+  // true if job is filled from the report of the same file, otherwise the caller analyzes the file and
+  // calls finish() while job.source is still set. 'file_key' is the content key if it was computed.
+  bool reuse(SourceJob & job, string & file_key)
+  {
+    string group = groupKey(job);
+    {
+      std::lock_guard<std::mutex> lock(entriesMutex);
+      if (++seenGroups[group] == 1)
+        return false;
+    }
+
+    file_key = contentKey(job, group);
+    std::shared_ptr<const SourceJob> found;
+    {
+      std::lock_guard<std::mutex> lock(entriesMutex);
+      auto it = reports.find(file_key);
+      if (it == reports.end())
+        return false;
+      found = it->second;
+    }
+
+    const SourceJob & from = *found;
+    job.report = from.report;
+    for (ReportedEvent & ev : job.report.events)
+      if (ev.cm.fileName == from.fileName)
+        CompilationContext::renameEventFile(ev, job.fileName);
+
+    job.declared = from.declared;
+    job.result = from.result;
+    job.analysisOk = from.analysisOk;
+    job.expectError = from.expectError;
+    job.expectWarningNumber = from.expectWarningNumber;
+    job.isError = from.isError;
+    job.tokenCount = from.tokenCount;
+    return true;
+  }
+
+  // report is kept if it does not depend on environment and another file of the same size was seen
+  void finish(const SourceJob & job, string & file_key)
+  {
+    if (!job.source || !resultcache::is_cacheable(job))
+      return;
+
+    if (file_key.empty())
+    {
+      string group = groupKey(job);
+      {
+        std::lock_guard<std::mutex> lock(entriesMutex);
+        if (seenGroups[group] < 2)
+          return;
+      }
+      file_key = contentKey(job, group);
+    }
+
+    std::shared_ptr<SourceJob> report = std::make_shared<SourceJob>(job);
+    report->source.reset();
+    std::lock_guard<std::mutex> lock(entriesMutex);
+    reports.insert(make_pair(file_key, std::shared_ptr<const SourceJob>(report)));
+  }
+};
+
+
+// dedupe state of files after the predefinition pass, only for batch mode where it is kept per file
+static map<string, set<string> > batch_predefinition_shown;
+
+
+// token counts of files analyzed by previous runs, kept in --cache-dir
+static map<string, uint64_t> file_costs;
+static bool file_costs_loaded = false;
+
+// files analyzed by this and previous runs with --journal
+static RunJournal run_journal;
+
+
+// Big files are started first, files sharing config and directory are started one after another, so workers
+// rarely switch settings and rarely collect the same export tables at the same time
+static vector<size_t> schedule_input_files(const AnalyzerOptions & options, const vector<string> & file_list)
+{
+  vector<ScheduledFile> files(file_list.size());
+  vector<string> configs(file_list.size());
+  vector<uint64_t> sizes(file_list.size(), 0);
+  uint64_t knownSize = 0;
+  uint64_t knownTokens = 0;
+
+  // file system lookups run on the pool, chunks of neighbour files share the directory cache of search_sqconfig()
+  const size_t chunkSize = 256;
+  run_ordered_jobs((file_list.size() + chunkSize - 1) / chunkSize, options.jobs,
+    [&](size_t chunk)
+    {
+      for (size_t i = chunk * chunkSize; i < min(file_list.size(), (chunk + 1) * chunkSize); i++)
+      {
+        struct stat st;
+        if (stat(file_list[i].c_str(), &st) == 0)
+          sizes[i] = uint64_t(st.st_size);
+
+        size_t slash = file_list[i].find_last_of("/\\");
+        configs[i] = settings::search_sqconfig(file_list[i].c_str());
+        files[i].group = configs[i] + "|" + (slash == string::npos ? string() : file_list[i].substr(0, slash + 1));
+      }
+    },
+    [](size_t) {});
+
+  for (size_t i = 0; i < file_list.size(); i++)
+  {
+    auto it = file_costs.find(file_list[i]);
+    if (it != file_costs.end())
+    {
+      knownSize += sizes[i];
+      knownTokens += it->second;
+    }
+  }
+
+  // token counts are converted to bytes by the average token size of these files
+  double bytesPerToken = knownTokens ? double(knownSize) / double(knownTokens) : 0.0;
+  size_t costByTokens = 0;
+  for (size_t i = 0; i < file_list.size(); i++)
+  {
+    auto it = file_costs.find(file_list[i]);
+    if (it != file_costs.end() && knownTokens)
+    {
+      files[i].cost = uint64_t(double(it->second) * bytesPerToken);
+      costByTokens++;
+    }
+    else
+      files[i].cost = sizes[i];
+  }
+
+  vector<size_t> order = schedule_largest_first(files);
+
+  if (options.verbose)
+  {
+    size_t groups = 0;
+    for (size_t k = 0; k < order.size(); k++)
+      if (k == 0 || files[order[k]].group != files[order[k - 1]].group)
+        groups++;
+
+    fprintf(stderr, "Schedule: %d files in %d groups on %d threads, cost of %d files is taken from the previous run, "
+      "of %d files from size\n", int(order.size()), int(groups), options.jobs, int(costByTokens),
+      int(order.size() - costByTokens));
+
+    for (size_t k = 0; k < order.size();)
+    {
+      size_t first = order[k];
+      size_t count = 0;
+      uint64_t cost = 0;
+      for (; k < order.size() && files[order[k]].group == files[first].group; k++, count++)
+        cost += files[order[k]].cost;
+
+      fprintf(stderr, "  %d files, cost %llu, config '%s', largest '%s' (cost %llu)\n", int(count),
+        (unsigned long long)cost, configs[first].c_str(), file_list[first].c_str(), (unsigned long long)files[first].cost);
+    }
+  }
+
+  return order;
+}
+
+
+// Files of --dir are analyzed while the directories are still being listed
+static int process_files_parallel(const AnalyzerOptions & options, const vector<string> & file_list)
+{
+  deque<SourceJob> sourceJobs; // references to elements stay valid while jobs are added and published jobs removed
+  size_t firstJobIndex = 0; // index of sourceJobs.front()
+  std::mutex sourceJobsMutex;
+  auto jobAt = [&](size_t i) -> SourceJob &
+  {
+    std::lock_guard<std::mutex> lock(sourceJobsMutex);
+    return sourceJobs[i - firstJobIndex];
+  };
+
+  bool keyed = !options.cacheDir.empty() || remote_cache.isOpen() || run_journal.isOpen();
+  string inputsDigest = keyed ? result_cache_inputs_digest(options) : string();
+  string costsFileName = options.cacheDir.empty() ? string() : join_path(options.cacheDir, "file_costs.txt");
+  if (!costsFileName.empty() && !file_costs_loaded)
+  {
+    load_file_costs(costsFileName, file_costs);
+    file_costs_loaded = true;
+  }
+  bool costsChanged = false;
+
+  // all files are looked up at once, so a mostly cached run costs a few round-trips instead of one per file,
+  // files of --dir are already in the list, see main(). Files which are not found keep their mapped text,
+  // so they are analyzed exactly as they were hashed and are not read twice.
+  vector<SourceJob> lookedUp; // by index in file_list, source and sqconfig of files to analyze
+  vector<string> lookedUpKeys; // empty if the file is read and hashed again by the analysis
+  if (remote_cache.isOpen() && !file_list.empty())
+  {
+    lookedUp.resize(file_list.size());
+    lookedUpKeys.resize(file_list.size());
+    run_ordered_jobs(file_list.size(), options.jobs,
+      [&](size_t i)
+      {
+        SourceJob & job = lookedUp[i];
+        job.fileName = file_list[i];
+        read_source_job_input(job);
+        if (job.source)
+          lookedUpKeys[i] = source_job_key(inputsDigest, job);
+      },
+      [](size_t) {});
+
+    vector<string> keys(lookedUpKeys);
+    keys.erase(std::remove(keys.begin(), keys.end(), string()), keys.end());
+    remote_cache.lookup(keys);
+
+    for (size_t i = 0; i < lookedUp.size(); i++)
+      if (lookedUp[i].source && (remote_cache.contains(lookedUpKeys[i]) || !lookedUp[i].source->isMapped()))
+      {
+        if (!lookedUp[i].source->isMapped())
+          lookedUpKeys[i].clear();
+        lookedUp[i].source.reset();
+      }
+  }
+
+  // input of a job prepared by the lookup, returns its key
+  auto takeLookedUpInput = [&](size_t i, SourceJob & job) -> string
+  {
+    if (i >= lookedUpKeys.size() || lookedUpKeys[i].empty())
+      return string();
+    job.source = std::move(lookedUp[i].source);
+    job.sqconfig = lookedUp[i].sqconfig;
+    return std::move(lookedUpKeys[i]);
+  };
+
+  // batch mode does not keep reports of analyzed files
+  DuplicateFiles duplicates(options);
+
+  int res = 0;
+  OrderedJobStream stream(options.jobs,
+    [&](size_t i)
+    {
+      SourceJob & job = jobAt(i);
+      string key = takeLookedUpInput(i, job);
+      if (key.empty() && !inputsDigest.empty())
+      {
+        if (!job.source)
+          read_source_job_input(job);
+        if (job.source)
+          key = source_job_key(inputsDigest, job);
+      }
+
+      if (!key.empty() && run_journal.isOpen())
+      {
+        string sqconfig = job.sqconfig;
+        if (run_journal.find(job.fileName, key, job))
+        {
+          job.source.reset();
+          switch_config_of_loaded_job(sqconfig);
+          return;
+        }
+      }
+
+      bool cached = !key.empty() && (!options.cacheDir.empty() || remote_cache.isOpen());
+      if (!cached || !load_cached_source_job(options, key, job))
+      {
+        string fileKey;
+        bool reused = false;
+        if (!options.batch)
+        {
+          if (!job.source)
+            read_source_job_input(job);
+          if (job.source)
+            reused = duplicates.reuse(job, fileKey);
+        }
+
+        if (!reused)
+        {
+          analyze_source_job(options, job, string(), job.sqconfig, job.source.get());
+          if (cached)
+            store_cached_source_job(options, key, job);
+          if (!options.batch)
+            duplicates.finish(job, fileKey);
+        }
+      }
+      job.source.reset();
+
+      if (!key.empty() && run_journal.isOpen() && resultcache::is_cacheable(job))
+        run_journal.append(job.fileName, key, job);
+    },
+    [&](size_t i)
+    {
+      SourceJob & job = jobAt(i);
+      if (options.batch)
+      {
+        // file can be already shown by the predefinition pass
+        auto it = batch_predefinition_shown.find(job.fileName);
+        set<string> shown = (it != batch_predefinition_shown.end()) ? it->second : set<string>();
+        CompilationContext::swapShownMessages(shown);
+      }
+
+      res |= publish_source_job(job);
+
+      if (job.tokenCount > 0 && !costsFileName.empty())
+      {
+        uint64_t & cost = file_costs[job.fileName];
+        costsChanged |= cost != uint64_t(job.tokenCount);
+        cost = uint64_t(job.tokenCount);
+      }
+
+      if (options.batch)
+      {
+        set<string> shown;
+        CompilationContext::swapShownMessages(shown);
+      }
+
+      std::lock_guard<std::mutex> lock(sourceJobsMutex);
+      sourceJobs.pop_front();
+      firstJobIndex++;
+    });
+
+  if (options.batch)
+    stream.setWindow(size_t(options.jobs) * 4); // reports of finished files wait for slower files before them
+
+  // files are read while the previous ones are analyzed, mapped files are touched so that cold reads
+  // (e.g. from network drives) are not on the critical path
+  size_t prefetchFiles = options.prefetchFiles < 0 ? size_t(max(options.jobs, 1)) * 2 : size_t(options.prefetchFiles);
+  if (prefetchFiles > 0)
+    stream.setPrepareStage([&](size_t i)
+      {
+        SourceJob & job = jobAt(i);
+        if (i < lookedUpKeys.size() && !lookedUpKeys[i].empty())
+          return lookedUp[i].source ? lookedUp[i].source->length() : size_t(0);
+        return read_source_job_input(job, true);
+      },
+      prefetchFiles, options.prefetchMemory);
+
+  auto addFile = [&](const string & file_name)
+  {
+    {
+      std::lock_guard<std::mutex> lock(sourceJobsMutex);
+      sourceJobs.push_back(SourceJob());
+      sourceJobs.back().fileName = file_name;
+    }
+    stream.add();
+  };
+
+  for (const string & fileName : file_list)
+    addFile(fileName);
+
+  // batch mode keeps the input order, it bounds the number of reports waiting for publishing
+  if (options.jobs > 1 && !options.batch && file_list.size() > 1)
+    stream.setStartOrder(schedule_input_files(options, file_list));
+
+  std::thread walker([&]()
+  {
+    for (const string & dir : options.inputDirs)
+      walk_directory(dir, options.dirFilter, options.jobs, addFile);
+    stream.close();
+  });
+
+  stream.run();
+  walker.join();
+
+  if (costsChanged)
+    save_file_costs(costsFileName, file_costs);
+
+  ever_declared.insert(published_declared.begin(), published_declared.end());
+  published_declared.clear();
+  return res;
+}
+
+
+// Predefinition files are parsed on worker threads, ident_root and ever_declared are updated in the order of files
+static int process_predefinition_files_parallel(const AnalyzerOptions & options, const vector<string> & file_list)
+{
+  vector<SourceJob> sourceJobs(file_list.size());
+  vector<IdentTreeFragment> fragments(file_list.size());
+  for (size_t i = 0; i < file_list.size(); i++)
+    sourceJobs[i].fileName = file_list[i];
+
+  int res = 0;
+  run_ordered_jobs(sourceJobs.size(), options.jobs,
+    [&](size_t i)
+    {
+      SourceJob & job = sourceJobs[i];
+      active_job = &job;
+      active_fragment = &fragments[i];
+      CompilationContext::activeReport = &job.report;
+      job.result = process_single_source(options, job.fileName, string(), string(), false, true);
+      CompilationContext::activeReport = nullptr;
+      active_fragment = nullptr;
+      active_job = nullptr;
+    },
+    [&](size_t i)
+    {
+      apply_ident_tree_fragment(fragments[i]);
+      ever_declared.insert(sourceJobs[i].declared.begin(), sourceJobs[i].declared.end());
+      sourceJobs[i].declared.clear();
+      res |= publish_source_job(sourceJobs[i]);
+
+      if (options.batch)
+      {
+        set<string> & shown = batch_predefinition_shown[sourceJobs[i].fileName];
+        shown.clear();
+        CompilationContext::swapShownMessages(shown);
+      }
+
+      sourceJobs[i] = SourceJob();
+    });
+
+  return res;
+}
+
+
+// Files are analyzed by worker processes, reports are published here in the order of input files
+static int process_files_distributed(const AnalyzerOptions & options, const vector<string> & file_list)
+{
+  vector<SourceJob> sourceJobs(file_list.size());
+  for (size_t i = 0; i < file_list.size(); i++)
+    sourceJobs[i].fileName = file_list[i];
+
+  vector<size_t> order = file_list.size() > 1 ? schedule_input_files(options, file_list) : vector<size_t>();
+
+  int res = 0;
+  bool ok = run_coordinator(options.coordinatorAddress, options.coordinatorPort, options.workerTimeoutSec,
+    result_cache_inputs_digest(options), file_list, order, options.verbose,
+    [&](size_t i, const string & data)
+    {
+      SourceJob & job = sourceJobs[i];
+      if (!deserialize_source_job(data.data(), data.size(), job))
+        return false;
+
+      switch_config_of_loaded_job(settings::search_sqconfig(job.fileName.c_str()));
+      return true;
+    },
+    [&](size_t i)
+    {
+      res |= publish_source_job(sourceJobs[i]);
+      sourceJobs[i] = SourceJob();
+    });
+
+  ever_declared.insert(published_declared.begin(), published_declared.end());
+  published_declared.clear();
+  return ok ? res : 1;
+}
+
+
+// Files received from the coordinator are analyzed on --jobs threads, each worker keeps its own configs and exports
+static int run_distributed_worker(const AnalyzerOptions & options)
+{
+  string inputsDigest = result_cache_inputs_digest(options);
+  bool cached = !options.cacheDir.empty() || remote_cache.isOpen();
+
+  bool ok = run_worker(options.workerHost, options.workerPort, inputsDigest, options.jobs, options.verbose,
+    [&](const string & file_name, string & result)
+    {
+      SourceJob job;
+      job.fileName = file_name;
+      read_source_job_input(job);
+      if (job.source && cached)
+        analyze_cached_source_job(options, source_job_key(inputsDigest, job), job);
+      else
+        analyze_source_job(options, job, string(), job.sqconfig, job.source.get());
+      job.source.reset();
+      serialize_source_job(job, result);
+    });
+
+  return ok ? 0 : 1;
+}
+
+
+// Analyzes a buffer sent to the server, messages are deduplicated only within this request,
+// messages and error level of files analyzed before the server was started are kept for the exit code and JSON output
+static int analyze_server_request(const AnalyzerOptions & options, const string & file_name, const string & code,
+  const string & sqconfig, string & response)
+{
+  SourceJob job;
+  job.fileName = file_name;
+  analyze_source_job(options, job, code, sqconfig);
+
+  vector<CompilerMessage> savedMessages;
+  set<string> savedShown;
+  int savedErrorLevel = 0;
+  CompilationContext::swapMessages(savedMessages, savedShown, savedErrorLevel);
+  settings::published_config_file_name = "?";
+  int res = publish_source_job(job);
+  published_declared.clear();
+
+  response = "{\"result\":" + to_string(res) + ",\"errorLevel\":" + to_string(CompilationContext::getErrorLevel()) + ",";
+  get_compiler_messages_as_string(response);
+  response += "}";
+
+  CompilationContext::swapMessages(savedMessages, savedShown, savedErrorLevel);
+  return res;
+}
+
+
+static void send_server_response(FILE * out, const string & response)
+{
+  fputs(response.c_str(), out);
+  fputs("\n###[END]\n", out);
+  fflush(out);
+}
+
+
+static void send_server_frame(FILE * out, const string & response)
+{
+  string frame;
+  write_stream_frame(frame, SF_RESPONSE, response.c_str(), response.length());
+  fwrite(frame.c_str(), 1, frame.length(), out);
+  fflush(out);
+}
+
+
+// Binary protocol: frames of the binary stream (see stream_frames.h), SF_CODE finishes the request and
+// is answered by SF_RESPONSE frame with the same JSON as in the text protocol. SF_RESET, SF_EXIT as below.
+static bool serve_frames_session(const AnalyzerOptions & options, FILE * in, FILE * out)
+{
+  string fileName;
+  string sqconfig;
+  StreamFrame frame;
+  bool corrupted = false;
+
+  while (read_stream_frame(in, frame, corrupted))
+  {
+    switch (frame.type)
+    {
+    case SF_FILE_NAME:
+      fileName = frame.payload;
+      break;
+    case SF_SQCONFIG:
+      sqconfig = frame.payload;
+      break;
+    case SF_TRUSTED_LOCAL:
+      trusted::add_line(trusted::TR_LOCAL, frame.payload);
+      break;
+    case SF_TRUSTED_GLOBAL:
+      trusted::add_line(trusted::TR_GLOBAL, frame.payload);
+      break;
+    case SF_TRUSTED_CONST:
+      trusted::add_line(trusted::TR_CONST, frame.payload);
+      break;
+    case SF_CODE:
+      {
+        string response;
+        analyze_server_request(options, fileName, frame.payload, sqconfig, response);
+        send_server_frame(out, response);
+
+        fileName.clear();
+        sqconfig.clear();
+        trusted::clear();
+      }
+      break;
+    case SF_RESET:
+      settings::clear_cache();
+      moduleexports::clear_cache();
+      send_server_frame(out, "{\"result\":0}");
+      break;
+    case SF_EXIT:
+      return false;
+    default:
+      send_server_frame(out, "{\"result\":1,\"error\":\"Unknown frame type " + to_string(frame.type) + "\"}");
+      return true; // the rest of input cannot be trusted, close the session
+    }
+  }
+
+  return true;
+}
+
+
+// Request: ###[FILE_NAME]<name>, optional ###[SQCONFIG]<file> and trusted identifiers (as in stream file),
+// then ###[CODE], lines of code and ###[END]. Empty code means that file will be read from disk.
+// Response: JSON with result and messages, followed by ###[END] line.
+// ###[RESET] drops cached configs and exports, ###[EXIT] stops the server.
+// Session which starts with the header of binary stream uses binary protocol, see serve_frames_session().
+static bool serve_session(const AnalyzerOptions & options, FILE * in, FILE * out)
+{
+  string line;
+  string fileName;
+  string sqconfig;
+  string code;
+  trusted::TrustedContext trustedContext = trusted::TR_CONST;
+  bool insideCode = false;
+
+  // text requests never start with the magic, so a partially matched prefix is the beginning of the first line
+  string header;
+  while (header.length() < STREAM_FRAMES_HEADER_SIZE)
+  {
+    int ch = fgetc(in);
+    if (ch == EOF)
+      break;
+    header += char(ch);
+    if (header.length() <= STREAM_FRAMES_MAGIC_SIZE && ch != STREAM_FRAMES_MAGIC[header.length() - 1])
+      break;
+  }
+
+  if (is_stream_frames_header(header.c_str(), header.length()))
+  {
+    if (header[STREAM_FRAMES_MAGIC_SIZE] != STREAM_FRAMES_VERSION)
+    {
+      send_server_frame(out, "{\"result\":1,\"error\":\"Unsupported protocol version\"}");
+      return true;
+    }
+    return serve_frames_session(options, in, out);
+  }
+
+  line = header;
+  bool haveLine = !header.empty();
+  if (haveLine && header.back() != '\n')
+  {
+    string rest;
+    if (read_line(in, rest))
+      line += rest;
+  }
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+    line.pop_back();
+
+  while (haveLine || read_line(in, line))
+  {
+    haveLine = false;
+
+    if (insideCode)
+    {
+      if (line != "###[END]")
+      {
+        code += line;
+        code += "\n";
+        continue;
+      }
+
+      string response;
+      analyze_server_request(options, fileName, code, sqconfig, response);
+      send_server_response(out, response);
+
+      insideCode = false;
+      fileName.clear();
+      sqconfig.clear();
+      code.clear();
+      trusted::clear();
+      trustedContext = trusted::TR_CONST;
+    }
+    else if (line == "###[EXIT]")
+      return false;
+    else if (line == "###[RESET]")
+    {
+      settings::clear_cache();
+      moduleexports::clear_cache();
+      send_server_response(out, "{\"result\":0}");
+    }
+    else if (!strncmp(line.c_str(), "###[FILE_NAME]", sizeof("###[FILE_NAME]") - 1))
+      fileName = line.substr(sizeof("###[FILE_NAME]") - 1);
+    else if (!strncmp(line.c_str(), "###[SQCONFIG]", sizeof("###[SQCONFIG]") - 1))
+      sqconfig = line.substr(sizeof("###[SQCONFIG]") - 1);
+    else if (line == "###[LOCALS]")
+      trustedContext = trusted::TR_LOCAL;
+    else if (line == "###[GLOBALS]")
+      trustedContext = trusted::TR_GLOBAL;
+    else if (line == "###[CONSTANTS]")
+      trustedContext = trusted::TR_CONST;
+    else if (line == "###[CODE]")
+      insideCode = true;
+    else if (!line.empty())
+      trusted::add_line(trustedContext, line);
+  }
+
+  return true;
+}
+
+
+static int run_analyzer_server(const AnalyzerOptions & options)
+{
+  CompilationContext::quietMessages = true;
+
+  auto handler = [&](FILE * in, FILE * out) { return serve_session(options, in, out); };
+  bool ok = options.serverSocket.empty() ? run_stdio_server(handler) :
+    run_socket_server(options.serverSocket.c_str(), handler);
+
+  CompilationContext::quietMessages = false;
+  return ok ? 0 : 1;
+}
+
+
+static bool start_watching(FileWatcher & watcher, const AnalyzerOptions & options, const vector<string> & file_list)
+{
+  if (!FileWatcher::isSupported())
+  {
+    CompilationContext::globalError("--watch is not supported on this platform");
+    return false;
+  }
+
+  bool ok = true;
+  for (const string & fileName : file_list)
+  {
+    size_t slash = fileName.find_last_of("/\\");
+    ok &= watcher.watch(slash == string::npos ? string() : fileName.substr(0, slash + 1), false);
+  }
+
+  for (const string & dir : options.inputDirs)
+    ok &= watcher.watch(dir, true);
+
+  if (!ok)
+    CompilationContext::globalError("Cannot watch input directories for changes");
+
+  return ok;
+}
+
+
+// Re-analyzes changed input files until the process is killed. Configs, export tables and ident_root
+// are kept from the previous passes, only changed .sqconfig drops settings and causes the full pass.
+// Declarations of files are recorded by the first pass, see watched_declarations.
+static int run_watch_mode(FileWatcher & watcher, const AnalyzerOptions & options, const vector<string> & file_list,
+  FileDeclarations & declarations)
+{
+  set<string> listedFiles(file_list.begin(), file_list.end());
+
+  AnalyzerOptions passOptions = options;
+  passOptions.inputDirs.clear(); // changed files are passed explicitly
+
+  fprintf(out_stream, "Watching for changes...\n");
+  fflush(out_stream);
+
+  for (;;)
+  {
+    set<string> changed;
+    if (!watcher.wait(changed, 100))
+    {
+      CompilationContext::globalError("Cannot read changes of watched directories");
+      return 1;
+    }
+
+    bool configChanged = false;
+    vector<string> changedFiles;
+    for (const string & fileName : changed)
+    {
+      size_t slash = fileName.find_last_of("/\\");
+      string name = slash == string::npos ? fileName : fileName.substr(slash + 1);
+      if (name == ".sqconfig")
+        configChanged = true;
+      else if (listedFiles.find(fileName) != listedFiles.end())
+        changedFiles.push_back(fileName);
+      else if (dir_walk_accepts_file(options.dirFilter, name))
+      {
+        for (const string & dir : options.inputDirs)
+          if (!fileName.compare(0, join_path(dir, "").length(), join_path(dir, "")))
+          {
+            changedFiles.push_back(fileName);
+            break;
+          }
+      }
+    }
+
+    if (configChanged)
+    {
+      settings::clear_cache();
+      changedFiles = file_list;
+      for (const string & dir : options.inputDirs)
+        walk_directory(dir, options.dirFilter, options.jobs, [&](const string & f) { changedFiles.push_back(f); });
+    }
+
+    for (const string & fileName : changed)
+      if (!ifstream(fileName).good())
+        declarations.declared.erase(fileName); // declarations of deleted files are gone for the next passes
+
+    changedFiles.erase(std::remove_if(changedFiles.begin(), changedFiles.end(),
+      [](const string & f) { return !ifstream(f).good(); }), changedFiles.end()); // deleted files
+
+    if (changedFiles.empty())
+      continue;
+
+    // changed files are published in the order of the first pass, each one sees declarations of unchanged files
+    // before it, declarations of changed files before it are added on publish as in a single run
+    set<string> changedSet(changedFiles.begin(), changedFiles.end()); // full pass lists files of --dir twice
+    changedFiles.assign(changedSet.begin(), changedSet.end());
+    map<string, size_t> position;
+    for (size_t i = 0; i < declarations.order.size(); i++)
+      position.insert(make_pair(declarations.order[i], i));
+    std::stable_sort(changedFiles.begin(), changedFiles.end(), [&](const string & a, const string & b)
+    {
+      auto pa = position.find(a);
+      auto pb = position.find(b);
+      return (pa != position.end() ? pa->second : position.size()) < (pb != position.end() ? pb->second : position.size());
+    });
+
+    set<string> declaredBefore;
+    for (const string & fileName : declarations.order)
+    {
+      if (changedSet.find(fileName) != changedSet.end())
+        declared_before_file[fileName].push_back(declaredBefore);
+      else
+      {
+        auto it = declarations.declared.find(fileName);
+        if (it != declarations.declared.end())
+          declaredBefore.insert(it->second.begin(), it->second.end());
+      }
+    }
+    ever_declared = declarations.predefined;
+
+    // warnings are shown again, even if they were shown by previous pass; messages of the first pass are kept
+    // for the exit code and JSON output
+    vector<CompilerMessage> savedMessages;
+    set<string> savedShown;
+    int savedErrorLevel = 0;
+    CompilationContext::swapMessages(savedMessages, savedShown, savedErrorLevel);
+    process_files_parallel(passOptions, changedFiles);
+    CompilationContext::swapMessages(savedMessages, savedShown, savedErrorLevel);
+    declared_before_file.clear();
+
+    fprintf(out_stream, "Analyzed %d changed file(s). Watching for changes...\n", int(changedFiles.size()));
+    fflush(out_stream);
+  }
+}
+
+
+const char * next_string(const char * p, string & out_str)
+{
+  out_str.clear();
+  out_str.reserve(100);
+  if (*p == 0x0d)
+    p++;
+  if (*p == 0x0a)
+    p++;
+
+  while (*p)
+  {
+    if (*p == 0x0d || *p == 0x0a)
+      break;
+
+    out_str += *p;
+    p++;
+  }
+  return p;
+}
+
+// Binary stream, sources are analyzed as soon as their frames are read
+static int process_stream_frames(const AnalyzerOptions & options, FILE * in, const char * stream_file_name)
+{
+  int res = 0;
+  string fileName;
+  string sqconfig;
+  StreamFrame frame;
+  bool corrupted = false;
+
+  while (read_stream_frame(in, frame, corrupted))
+  {
+    switch (frame.type)
+    {
+    case SF_FILE_NAME:
+      fileName = frame.payload;
+      trusted::clear();
+      break;
+    case SF_SQCONFIG:
+      sqconfig = frame.payload;
+      break;
+    case SF_TRUSTED_LOCAL:
+      trusted::add_line(trusted::TR_LOCAL, frame.payload);
+      break;
+    case SF_TRUSTED_GLOBAL:
+      trusted::add_line(trusted::TR_GLOBAL, frame.payload);
+      break;
+    case SF_TRUSTED_CONST:
+      trusted::add_line(trusted::TR_CONST, frame.payload);
+      break;
+    case SF_CODE:
+      if (frame.payload.empty())
+        res |= process_single_source(options, fileName, string(), sqconfig, false, false);
+      else
+      {
+        SourceText code;
+        code.view(frame.payload);
+        res |= process_single_source(options, fileName, string(), sqconfig, false, false, &code);
+      }
+      break;
+    default:
+      CompilationContext::globalError((string("Unknown frame type ") + to_string(frame.type) + " in stream '" +
+        stream_file_name + "'").c_str());
+      return 1;
+    }
+  }
+
+  if (corrupted)
+  {
+    CompilationContext::globalError((string("Unexpected end of stream '") + stream_file_name + "'").c_str());
+    return 1;
+  }
+
+  return res;
+}
+
+
+// '-' for stdin. Stream is either binary (see stream_frames.h) or text with ###[...] sections
+int process_stream_file(const AnalyzerOptions & options, const char * stream_file_name)
+{
+  bool isStdin = !strcmp(stream_file_name, "-");
+#if defined(_WIN32)
+  if (isStdin)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  FILE * in = isStdin ? stdin : fopen(stream_file_name, "rb");
+  if (!in)
+  {
+    CompilationContext::globalError((string("Cannot open strem file '") + stream_file_name + "'").c_str());
+    return 1;
+  }
+
+  char header[STREAM_FRAMES_HEADER_SIZE];
+  size_t headerSize = fread(header, 1, sizeof(header), in);
+  if (is_stream_frames_header(header, headerSize))
+  {
+    int res = 0;
+    if (header[STREAM_FRAMES_MAGIC_SIZE] != STREAM_FRAMES_VERSION)
+    {
+      CompilationContext::globalError((string("Unsupported version of stream '") + stream_file_name + "'").c_str());
+      res = 1;
+    }
+    else
+      res = process_stream_frames(options, in, stream_file_name);
+
+    if (!isStdin)
+      fclose(in);
+    return res;
+  }
+
+  string stream(header, headerSize);
+  char buf[65536];
+  for (size_t n = 0; (n = fread(buf, 1, sizeof(buf), in)) > 0;)
+    stream.append(buf, n);
+
+  if (!isStdin)
+    fclose(in);
+
+  if (stream.empty())
+  {
+    CompilationContext::globalError((string("Stream file is empty '") + stream_file_name + "'").c_str());
+    return 1;
+  }
+
+  int res = 0;
+  const char * p = stream.c_str();
+
+  string fileName;
+  trusted::TrustedContext trustedContext = trusted::TR_CONST;
+  string code;
+  string sqconfig;
+  bool insideCode = false;
+
+  for (;;)
+  {
+    string buf;
+    p = next_string(p, buf);
+
+    if (insideCode)
+    {
+      if (buf[0] != '#' || buf[1] != '#')
+      {
+        code += buf;
+        code += "\n";
+      }
+
+      if ((buf[0] == '#' && buf[1] == '#') || !*p) // end of code
+      {
+        res |= process_single_source(options, fileName, code, sqconfig, false, false);
+        insideCode = false;
+      }
+    }
+
+    if (!*p)
+      break;
+
+    if (!strncmp(buf.c_str(), "###[FILE_NAME]", sizeof("###[FILE_NAME]") - 1))
     {
       fileName = string(buf.c_str() + sizeof("###[FILE_NAME]") - 1);
       trusted::clear();
@@ -4454,15 +5955,7 @@ int process_stream_file(const char * stream_file_name)
       insideCode = true;
     }
     else if (!buf.empty() && !insideCode)
-    {
-      const char * dot = strchr(buf.c_str(), '.');
-      string parent(buf.c_str(), dot ? dot - buf.c_str() : buf.length());
-      string child;
-      if (dot)
-        child = string(dot + 1);
-
-      trusted::add(trustedContext, parent, child);
-    }
+      trusted::add_line(trustedContext, buf);
   }
 
   return res;
@@ -4480,8 +5973,17 @@ static void check_unrecorgnized_args_before_exit()
 }
 
 
+static void drop_compiler_message(const CompilerMessage &)
+{
+}
+
+
 void before_exit()
 {
+  moduleexports::wait_root_table_prefetch();
+  run_journal.close();
+  remote_cache.close();
+
   if (CompilationContext::redirectMessagesToJson)
     if (!compiler_messages_to_json(CompilationContext::redirectMessagesToJson))
       CompilationContext::setErrorLevel(ERRORLEVEL_FATAL);
@@ -4494,6 +5996,9 @@ void before_exit()
 
 void before_exit_check_args()
 {
+  moduleexports::wait_root_table_prefetch();
+  run_journal.close();
+  remote_cache.close();
   check_unrecorgnized_args_before_exit();
 
   if (CompilationContext::redirectMessagesToJson)
@@ -4561,9 +6066,6 @@ int main(int argc, char ** argv)
     return CompilationContext::getErrorLevel();
   }
 
-  bool printTokens = false;
-  bool printAst = false;
-
   const char * streamFile = nullptr;
   vector <string> fileList;
   vector <string> predefinitionFileList;
@@ -4584,12 +6086,6 @@ int main(int argc, char ** argv)
       used_args.insert(i);
     }
 
-    if (!strncmp(arg, "--tokens-output-file:", 21))
-      printTokens = true;
-
-    if (!strncmp(arg, "--ast-output-file:", 18))
-      printAst = true;
-
     bool isFiles = !strncmp(arg, "--files:", 8);
     bool isPredefinitionFiles = !strncmp(arg, "--predefinition-files:", 22);
     if (isPredefinitionFiles)
@@ -4627,11 +6123,60 @@ int main(int argc, char ** argv)
   }
 
 
+  AnalyzerOptions options;
+  parse_analyzer_options(argc, argv, options, used_args);
+  moduleexports::csq_exe = options.csqExe;
+  if (!options.cacheDir.empty())
+    moduleexports::export_cache_dir = join_path(options.cacheDir, "exports");
+
   string sourceCode;
   int res = 0;
 
+  if (options.batch && !options.printTokensToJson && !options.printAstToJson)
+  {
+    // published messages are not kept, cached exports are limited, see process_files_parallel() for the rest
+    moduleexports::max_cached_modules = 256;
+    if (CompilationContext::redirectMessagesToJson)
+    {
+      if (!compiler_messages_stream_begin(CompilationContext::redirectMessagesToJson))
+      {
+        before_exit();
+        return CompilationContext::getErrorLevel();
+      }
+      CompilationContext::messageSink = compiler_messages_stream_write;
+    }
+    else
+      CompilationContext::messageSink = drop_compiler_message;
+  }
+
+  // long running modes analyze files while they are being edited
+  if (options.watch || options.server)
+    SourceText::mapFiles = false;
+
+  if (!options.mergeResults.empty())
+  {
+    merge_result_files(options.mergeResults, options.outputMode, fileList);
+    before_exit_check_args();
+    return CompilationContext::getErrorLevel();
+  }
+
+  if (options.shardCount < 0)
+  {
+    CompilationContext::globalError("Invalid --shard, expected --shard:<index>/<count> where 1 <= index <= count");
+    before_exit();
+    return CompilationContext::getErrorLevel();
+  }
 
-  if (printTokens || printAst)
+  if (options.coordinatorPort < 0 || options.workerPort < 0)
+  {
+    CompilationContext::globalError(options.coordinatorPort < 0 ? "Invalid --coordinator, expected --coordinator:[<address>:]<port>" :
+      "Invalid --worker, expected --worker:<host>:<port>");
+    before_exit();
+    return CompilationContext::getErrorLevel();
+  }
+
+
+  if (options.printTokensToJson || options.printAstToJson)
   {
     if (streamFile || fileList.size() != 1)
     {
@@ -4640,7 +6185,7 @@ int main(int argc, char ** argv)
       return CompilationContext::getErrorLevel();
     }
 
-    res |= process_single_source(fileList[0], sourceCode, string(), false, false);
+    res |= process_single_source(options, fileList[0], sourceCode, string(), false, false);
     if (res)
       CompilationContext::setErrorLevel(ERRORLEVEL_WARNING);
 
@@ -4651,27 +6196,98 @@ int main(int argc, char ** argv)
 
   if (streamFile)
   {
-    res = process_stream_file(streamFile);
+    res = process_stream_file(options, streamFile);
   }
   else
   {
-    if (fileList.empty())
+    for (const string & dir : options.inputDirs)
+      if (!is_directory(dir))
+      {
+        CompilationContext::globalError((string("Cannot open directory '") + dir + "'").c_str());
+        before_exit();
+        return CompilationContext::getErrorLevel();
+      }
+
+    if (fileList.empty() && options.inputDirs.empty() && !options.server && options.workerPort == 0)
     {
       CompilationContext::globalError("Expected file name");
       before_exit();
       return CompilationContext::getErrorLevel();
     }
 
+    start_root_table_prefetch(options, fileList);
+
+    if (options.shardCount > 0 || !options.cacheUrl.empty() || options.coordinatorPort > 0)
+    {
+      // all agents must see the whole list to split it in the same way, remote cache looks up all files at once,
+      // coordinator hands out files by their index
+      for (const string & dir : options.inputDirs)
+        walk_directory(dir, options.dirFilter, options.jobs, [&](const string & f) { fileList.push_back(f); });
+      options.inputDirs.clear();
+      if (options.shardCount > 0)
+        fileList = select_shard_with_declarations(options, fileList);
+    }
+
     if (two_pass_scan)
     {
-      for (string & fileName : predefinitionFileList)
-        res |= process_single_source(fileName, sourceCode, string(), true, true);
+      res |= process_predefinition_files_parallel(options, predefinitionFileList);
 
       //dump_ident_root(0, &ident_root);
     }
 
-    for (string & fileName : fileList)
-      res |= process_single_source(fileName, sourceCode, string(), true, false);
+    // digest depends on identifiers of the predefinition pass
+    if (!options.journalFile.empty() && !run_journal.open(options.journalFile, result_cache_inputs_digest(options)))
+    {
+      CompilationContext::globalError((string("Cannot open journal file '") + options.journalFile + "'").c_str());
+      before_exit();
+      return CompilationContext::getErrorLevel();
+    }
+
+    if (!options.cacheUrl.empty() && !remote_cache.open(options.cacheUrl))
+    {
+      CompilationContext::globalError((string("Invalid --cache-url '") + options.cacheUrl +
+        "', expected http://<host>[:<port>][/<path>]").c_str());
+      before_exit();
+      return CompilationContext::getErrorLevel();
+    }
+
+    FileWatcher watcher(options.dirFilter);
+    if (options.watch && !start_watching(watcher, options, fileList))
+    {
+      before_exit();
+      return CompilationContext::getErrorLevel();
+    }
+
+    FileDeclarations declarations;
+    if (options.watch)
+    {
+      declarations.predefined = ever_declared;
+      watched_declarations = &declarations;
+    }
+
+    if (options.workerPort > 0)
+      res |= run_distributed_worker(options);
+    else if (options.coordinatorPort > 0)
+      res |= process_files_distributed(options, fileList);
+    else
+      res |= process_files_parallel(options, fileList);
+
+    if (options.watch)
+      res |= run_watch_mode(watcher, options, fileList, declarations);
+
+    if (options.server)
+    {
+      if (CompilationContext::messageSink == drop_compiler_message)
+        CompilationContext::messageSink = nullptr; // responses are made of collected messages
+      res |= run_analyzer_server(options);
+    }
+  }
+
+  if (remote_cache.isOpen())
+  {
+    remote_cache.close();
+    if (options.verbose)
+      remote_cache.printStatistics(stderr);
   }
 
   if (res)
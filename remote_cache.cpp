@@ -0,0 +1,318 @@
+#include "remote_cache.h"
+
+#include <functional>
+#include <set>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+
+static const size_t send_chunk_size = 65536;
+
+
+struct HttpResponse
+{
+  int status;
+  string body;
+  bool closeConnection;
+};
+
+
+static bool header_is(const string & line, const char * name)
+{
+  size_t len = strlen(name);
+  if (line.length() <= len || line[len] != ':')
+    return false;
+
+  for (size_t i = 0; i < len; i++)
+    if (tolower((unsigned char)line[i]) != name[i])
+      return false;
+
+  return true;
+}
+
+
+static string header_value(const string & line)
+{
+  size_t b = line.find_first_not_of(" \t", line.find(':') + 1);
+  return b == string::npos ? string() : line.substr(b);
+}
+
+
+static bool read_response(TcpConnection & conn, HttpResponse & response)
+{
+  string line;
+  if (!conn.readLine(line) || line.compare(0, 5, "HTTP/") || line.find(' ') == string::npos)
+    return false;
+
+  response.status = atoi(line.c_str() + line.find(' ') + 1);
+  response.closeConnection = !line.compare(0, 8, "HTTP/1.0");
+  size_t contentLength = 0;
+
+  for (;;)
+  {
+    if (!conn.readLine(line))
+      return false;
+
+    if (line.empty())
+      break;
+
+    if (header_is(line, "content-length"))
+      contentLength = size_t(strtoull(header_value(line).c_str(), nullptr, 10));
+    else if (header_is(line, "connection"))
+      response.closeConnection = !strncmp(header_value(line).c_str(), "close", 5);
+    else if (header_is(line, "transfer-encoding"))
+      return false; // only Content-Length is supported
+  }
+
+  return conn.readExact(contentLength, response.body);
+}
+
+
+// Requests are sent without waiting for responses, responses come in the same order (HTTP/1.1 pipelining).
+// If the server closes the connection, the rest of requests is sent again on a new connection.
+// Returns false on network errors.
+static bool exchange_pipelined(TcpConnection & conn, const string & host, int port, const vector<string> & requests,
+  const function<void(size_t, const HttpResponse &)> & on_response, int & batches)
+{
+  size_t done = 0;
+  int failures = 0;
+  while (done < requests.size())
+  {
+    if (!conn.isOpen() && !conn.connect(host, port))
+      return false;
+
+    batches++;
+    size_t first = done;
+
+    // sending on its own thread, so responses are read while the server is reading requests
+    std::thread sender([&]()
+    {
+      string chunk;
+      for (size_t i = first; i < requests.size(); i++)
+      {
+        chunk += requests[i];
+        if (chunk.length() >= send_chunk_size || i + 1 == requests.size())
+        {
+          if (!conn.sendAll(chunk))
+            break;
+          chunk.clear();
+        }
+      }
+    });
+
+    bool closed = false;
+    while (done < requests.size() && !closed)
+    {
+      HttpResponse response;
+      if (!read_response(conn, response))
+        break;
+
+      on_response(done, response);
+      done++;
+      closed = response.closeConnection;
+    }
+
+    if (done < requests.size())
+      conn.shutdown();
+    sender.join();
+
+    if (done < requests.size() || closed)
+      conn.close();
+
+    if (done == first && ++failures > 1)
+      return false;
+    if (done > first)
+      failures = 0;
+  }
+
+  return true;
+}
+
+
+RemoteResultCache::RemoteResultCache() : port(0), available(false), closing(false), lookupCount(0),
+  lookupHits(0), lookupRequests(0), uploadCount(0), uploadRequests(0)
+{
+}
+
+
+RemoteResultCache::~RemoteResultCache()
+{
+  close();
+}
+
+
+bool RemoteResultCache::open(const string & cache_url)
+{
+  close();
+
+  if (cache_url.compare(0, 7, "http://"))
+    return false;
+
+  size_t hostBegin = 7;
+  size_t pathBegin = cache_url.find('/', hostBegin);
+  if (pathBegin == string::npos)
+    pathBegin = cache_url.length();
+
+  string hostPort = cache_url.substr(hostBegin, pathBegin - hostBegin);
+  size_t colon = hostPort.rfind(':');
+  int urlPort = 80;
+  if (colon != string::npos && hostPort.find(']', colon) == string::npos)
+  {
+    urlPort = atoi(hostPort.c_str() + colon + 1);
+    hostPort.resize(colon);
+  }
+
+  if (hostPort.length() > 2 && hostPort.front() == '[' && hostPort.back() == ']')
+    hostPort = hostPort.substr(1, hostPort.length() - 2);
+
+  if (hostPort.empty() || urlPort <= 0 || urlPort > 65535)
+    return false;
+
+  url = cache_url;
+  host = hostPort;
+  port = urlPort;
+  basePath = cache_url.substr(pathBegin);
+  if (basePath.empty() || basePath.back() != '/')
+    basePath += '/';
+
+  available = true;
+  closing = false;
+  uploader = std::thread([this]() { uploadLoop(); });
+  return true;
+}
+
+
+void RemoteResultCache::close()
+{
+  if (!isOpen())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    closing = true;
+  }
+  uploadCv.notify_all();
+  uploader.join();
+
+  port = 0;
+  found.clear();
+}
+
+
+void RemoteResultCache::disable()
+{
+  if (available)
+    fprintf(stderr, "WARNING: remote cache '%s' is not available, results are not shared.\n", url.c_str());
+  available = false;
+}
+
+
+void RemoteResultCache::lookup(const vector<string> & keys)
+{
+  if (!isOpen() || !available)
+    return;
+
+  set<string> uniqueKeys(keys.begin(), keys.end());
+  vector<string> requested(uniqueKeys.begin(), uniqueKeys.end());
+  vector<string> requests;
+  requests.reserve(requested.size());
+  for (const string & key : requested)
+    requests.push_back("GET " + basePath + key + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n");
+
+  lookupCount += int(requests.size());
+
+  TcpConnection conn;
+  bool ok = exchange_pipelined(conn, host, port, requests,
+    [&](size_t i, const HttpResponse & response)
+    {
+      if (response.status == 200)
+        found[requested[i]] = response.body;
+    },
+    lookupRequests);
+
+  lookupHits = int(found.size());
+  if (!ok)
+  {
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    disable();
+  }
+}
+
+
+bool RemoteResultCache::load(const string & key, SourceJob & job) const
+{
+  auto it = found.find(key);
+  if (it == found.end())
+    return false;
+
+  return deserialize_cache_entry(it->second.data(), it->second.size(), key, job);
+}
+
+
+void RemoteResultCache::store(const string & key, const SourceJob & job)
+{
+  if (!isOpen() || found.find(key) != found.end())
+    return;
+
+  string data;
+  serialize_cache_entry(key, job, data);
+
+  {
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    if (!available)
+      return;
+    uploadQueue.push_back(make_pair(key, std::move(data)));
+  }
+  uploadCv.notify_one();
+}
+
+
+void RemoteResultCache::uploadLoop()
+{
+  TcpConnection conn;
+  for (;;)
+  {
+    vector<pair<string, string>> entries;
+    {
+      std::unique_lock<std::mutex> lock(uploadMutex);
+      uploadCv.wait(lock, [&]() { return closing || !uploadQueue.empty(); });
+      if (uploadQueue.empty())
+        break;
+      entries.swap(uploadQueue);
+    }
+
+    vector<string> requests;
+    requests.reserve(entries.size());
+    for (auto && entry : entries)
+      requests.push_back("PUT " + basePath + entry.first + " HTTP/1.1\r\nHost: " + host +
+        "\r\nContent-Type: application/octet-stream\r\nContent-Length: " + to_string(entry.second.length()) +
+        "\r\n\r\n" + entry.second);
+
+    int uploaded = 0;
+    bool ok = exchange_pipelined(conn, host, port, requests,
+      [&](size_t, const HttpResponse & response)
+      {
+        if (response.status >= 200 && response.status < 300)
+          uploaded++;
+      },
+      uploadRequests);
+
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    uploadCount += uploaded;
+    if (!ok)
+    {
+      disable();
+      uploadQueue.clear();
+    }
+  }
+}
+
+
+void RemoteResultCache::printStatistics(FILE * out) const
+{
+  fprintf(out, "Remote cache: %d of %d files found in %d batch(es) of requests, %d result(s) uploaded in %d batch(es)\n",
+    lookupHits, lookupCount, lookupRequests, uploadCount, uploadRequests);
+}
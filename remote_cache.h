@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include "source_job.h"
+#include "tcp_connection.h"
+
+
+// Analysis results shared by build agents over HTTP, keys and entries are the same as in the on-disk cache
+// (see result_cache.h). GET <url>/<key> returns the entry (status 200) or status 404, PUT <url>/<key> stores it.
+// All input files are looked up before the analysis with pipelined requests on one connection, results of
+// analyzed files are uploaded in background. drey/result_cache_server.py is a server for tests and self-hosting.
+class RemoteResultCache
+{
+  std::string url;
+  std::string host;
+  int port;
+  std::string basePath; // ends with '/'
+  bool available; // false after the first network error, results are not shared after that
+
+  std::map<std::string, std::string> found; // key -> serialized job, not changed during the analysis
+
+  std::mutex uploadMutex;
+  std::condition_variable uploadCv;
+  std::vector<std::pair<std::string, std::string>> uploadQueue; // key, serialized job
+  bool closing;
+  std::thread uploader;
+
+  int lookupCount;
+  int lookupHits;
+  int lookupRequests; // batches of pipelined requests
+  int uploadCount;
+  int uploadRequests;
+
+  void uploadLoop();
+  void disable(); // uploadMutex must be locked
+
+  RemoteResultCache(const RemoteResultCache &) = delete;
+  RemoteResultCache & operator=(const RemoteResultCache &) = delete;
+
+public:
+  RemoteResultCache();
+  ~RemoteResultCache();
+
+  bool open(const std::string & cache_url); // false if url is not 'http://host[:port][/path]'
+  void close(); // waits until all results are uploaded
+  bool isOpen() const { return port > 0; }
+
+  void lookup(const std::vector<std::string> & keys);
+  bool contains(const std::string & key) const { return found.find(key) != found.end(); } // found by lookup()
+  bool load(const std::string & key, SourceJob & job) const; // only keys passed to lookup() can be found
+  void store(const std::string & key, const SourceJob & job);
+  void printStatistics(FILE * out) const;
+};
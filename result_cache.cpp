@@ -0,0 +1,72 @@
+#include "result_cache.h"
+#include "atomic_file.h"
+#include "module_exports.h"
+
+#include <stdio.h>
+
+using namespace std;
+
+namespace resultcache
+{
+  static string entry_dir(const string & cache_dir, const string & key)
+  {
+    return cache_dir + "/" + key.substr(0, 2);
+  }
+
+  static string entry_file_name(const string & cache_dir, const string & key)
+  {
+    return entry_dir(cache_dir, key) + "/" + key.substr(2) + ".qsa";
+  }
+
+
+  bool load(const string & cache_dir, const string & key, SourceJob & job)
+  {
+    FILE * f = fopen(entry_file_name(cache_dir, key).c_str(), "rb");
+    if (!f)
+      return false;
+
+    string data;
+    char buf[16384];
+    size_t n = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      data.append(buf, n);
+    fclose(f);
+
+    return deserialize_cache_entry(data.data(), data.size(), key, job);
+  }
+
+
+  void store(const string & cache_dir, const string & key, const SourceJob & job)
+  {
+    string data;
+    serialize_cache_entry(key, job, data);
+
+    make_dir(cache_dir);
+    if (make_dir(entry_dir(cache_dir, key)))
+      write_file_atomically(entry_file_name(cache_dir, key), data);
+  }
+
+
+  bool is_cacheable(const SourceJob & job)
+  {
+    static const int timeBudgetWarningId = CompilationContext::findWarningId("time-budget-exceeded");
+    for (const ReportedEvent & ev : job.report.events)
+    {
+      if (ev.type == RE_STDOUT_TEXT)
+        return false;
+
+      if (ev.type == RE_ERROR_LEVEL && ev.errorLevel == ERRORLEVEL_FATAL)
+        return false;
+
+      if (ev.type == RE_MESSAGE && ev.cm.isError && ev.cm.intId >= moduleexports::ERROR_TEMP_FILE &&
+          ev.cm.intId <= moduleexports::ERROR_REQUIRE)
+        return false;
+
+      // rules skipped by --file-time-budget
+      if (ev.type == RE_MESSAGE && !ev.cm.isError && ev.cm.intId == timeBudgetWarningId)
+        return false;
+    }
+
+    return true;
+  }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include "source_job.h"
+
+
+// On-disk cache of analysis results, each entry is a file named by the hash of all inputs of the analysis
+namespace resultcache
+{
+  bool load(const std::string & cache_dir, const std::string & key, SourceJob & job);
+  void store(const std::string & cache_dir, const std::string & key, const SourceJob & job);
+  bool is_cacheable(const SourceJob & job); // results depending on the environment (e.g. csq failures) are not cached
+}
@@ -0,0 +1,198 @@
+#include "run_journal.h"
+#include "atomic_file.h"
+#include "content_hash.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#  include <io.h>
+#  define sync_file(f) _commit(_fileno(f))
+#else
+#  include <unistd.h>
+#  define sync_file(f) fsync(fileno(f))
+#endif
+
+using namespace std;
+
+
+static const char journal_magic[] = "QSAJRNL1";
+static const int max_unsynced_records = 64;
+static const int sync_interval_ms = 1000;
+static const size_t record_hash_size = 32;
+
+
+static void write_uint32(string & out, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    out += char((value >> (i * 8)) & 0xFF);
+}
+
+static uint32_t read_uint32(const char * p)
+{
+  const unsigned char * u = (const unsigned char *)p;
+  return uint32_t(u[0]) | (uint32_t(u[1]) << 8) | (uint32_t(u[2]) << 16) | (uint32_t(u[3]) << 24);
+}
+
+static bool read_string(const char *& ptr, const char * end, string & str)
+{
+  if (end - ptr < 4)
+    return false;
+
+  uint32_t len = read_uint32(ptr);
+  ptr += 4;
+  if (len > size_t(end - ptr))
+    return false;
+
+  str.assign(ptr, len);
+  ptr += len;
+  return true;
+}
+
+
+RunJournal::RunJournal() : file(nullptr), unsyncedRecords(0)
+{
+}
+
+
+RunJournal::~RunJournal()
+{
+  close();
+}
+
+
+bool RunJournal::open(const string & file_name, const string & run_digest)
+{
+  close();
+  recorded.clear();
+
+  string data;
+  FILE * f = fopen(file_name.c_str(), "rb");
+  if (f)
+  {
+    char buf[16384];
+    size_t n = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      data.append(buf, n);
+    fclose(f);
+  }
+
+  string header = string(journal_magic) + run_digest;
+  size_t validEnd = 0;
+
+  // records of a run with other inputs are never reused, the journal is started again
+  if (data.size() >= header.size() && !data.compare(0, header.size(), header))
+  {
+    validEnd = header.size();
+    while (data.size() - validEnd >= 4 + record_hash_size)
+    {
+      uint32_t len = read_uint32(data.data() + validEnd);
+      size_t payloadPos = validEnd + 4 + record_hash_size;
+      if (len > data.size() - payloadPos)
+        break;
+
+      string payload = data.substr(payloadPos, len);
+      if (data.compare(validEnd + 4, record_hash_size, content_hash_hex(payload)))
+        break;
+
+      const char * ptr = payload.data();
+      const char * end = ptr + payload.size();
+      string name, key;
+      if (!read_string(ptr, end, name) || !read_string(ptr, end, key))
+        break;
+
+      recorded[name] = make_pair(key, string(ptr, end));
+      validEnd = payloadPos + len;
+    }
+  }
+
+  if (validEnd == 0 || validEnd < data.size())
+  {
+    // written to temporary file and renamed, so the records are never lost if this run is killed now
+    data.resize(validEnd);
+    if (data.empty())
+      data = header;
+    if (!write_file_atomically(file_name, data, true))
+    {
+      recorded.clear();
+      return false;
+    }
+  }
+
+  file = fopen(file_name.c_str(), "ab");
+  if (!file)
+  {
+    recorded.clear();
+    return false;
+  }
+
+  unsyncedRecords = 0;
+  lastSyncTime = std::chrono::steady_clock::now();
+  return true;
+}
+
+
+void RunJournal::sync()
+{
+  fflush(file);
+  sync_file(file);
+  unsyncedRecords = 0;
+  lastSyncTime = std::chrono::steady_clock::now();
+}
+
+
+void RunJournal::close()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!file)
+    return;
+
+  sync();
+  fclose(file);
+  file = nullptr;
+}
+
+
+bool RunJournal::find(const string & file_name, const string & key, SourceJob & job) const
+{
+  auto it = recorded.find(file_name);
+  if (it == recorded.end() || it->second.first != key)
+    return false;
+
+  SourceJob recordedJob;
+  if (!deserialize_source_job(it->second.second.data(), it->second.second.size(), recordedJob))
+    return false;
+
+  recordedJob.fileName = job.fileName;
+  job = recordedJob;
+  return true;
+}
+
+
+void RunJournal::append(const string & file_name, const string & key, const SourceJob & job)
+{
+  string payload;
+  write_uint32(payload, uint32_t(file_name.length()));
+  payload += file_name;
+  write_uint32(payload, uint32_t(key.length()));
+  payload += key;
+  serialize_source_job(job, payload);
+
+  string record;
+  write_uint32(record, uint32_t(payload.length()));
+  record += content_hash_hex(payload);
+  record += payload;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!file)
+    return;
+
+  // written at once, so records of analyzed files survive if the process is killed, fsync is for system crashes
+  fwrite(record.data(), 1, record.size(), file);
+  fflush(file);
+
+  if (++unsyncedRecords >= max_unsynced_records ||
+    std::chrono::steady_clock::now() - lastSyncTime >= std::chrono::milliseconds(sync_interval_ms))
+  {
+    sync();
+  }
+}
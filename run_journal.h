@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <stdio.h>
+#include "source_job.h"
+
+
+// Append-only log of analyzed files for --journal. A run killed partway through is resumed with the same
+// journal: recorded files with the same inputs are not analyzed again, their reports are replayed.
+// File starts with "QSAJRNL1" and the digest of run inputs, then records: payload length (uint32, little endian),
+// hash of payload (32 hex digits) and payload (file name, key of inputs of the file and serialized job).
+// Records are written as soon as files are analyzed, fsync is called for batches of records.
+class RunJournal
+{
+  FILE * file;
+  std::mutex mutex;
+  std::map<std::string, std::pair<std::string, std::string>> recorded; // file name -> key, serialized job
+  int unsyncedRecords;
+  std::chrono::steady_clock::time_point lastSyncTime;
+
+  void sync();
+
+  RunJournal(const RunJournal &) = delete;
+  RunJournal & operator=(const RunJournal &) = delete;
+
+public:
+  RunJournal();
+  ~RunJournal();
+
+  // Records of the previous run are kept if it had the same run digest, partially written tail is dropped
+  bool open(const std::string & file_name, const std::string & run_digest);
+  void close();
+  bool isOpen() const { return file != nullptr; }
+  size_t recordedCount() const { return recorded.size(); }
+
+  // thread safe, recorded files are not changed after open()
+  bool find(const std::string & file_name, const std::string & key, SourceJob & job) const;
+  void append(const std::string & file_name, const std::string & key, const SourceJob & job);
+};
@@ -0,0 +1,362 @@
+#include "shards.h"
+#include "content_hash.h"
+
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+static string normalize_path(const string & path)
+{
+  string res;
+  res.reserve(path.length());
+  for (char c : path)
+  {
+    char ch = (c == '\\') ? '/' : c;
+    if (ch == '/' && !res.empty() && res.back() == '/')
+      continue;
+    res += ch;
+  }
+
+  while (!res.compare(0, 2, "./"))
+    res.erase(0, 2);
+
+  for (size_t pos = res.find("/./"); pos != string::npos; pos = res.find("/./"))
+    res.erase(pos, 2);
+
+  return res;
+}
+
+
+vector<size_t> select_shard_files(const vector<string> & files, int index, int count)
+{
+  struct Item
+  {
+    size_t pos;
+    uint64_t weight;
+    string hash;
+  };
+
+  vector<Item> items(files.size());
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    struct stat st;
+    items[i].pos = i;
+    items[i].weight = (stat(files[i].c_str(), &st) == 0 ? uint64_t(st.st_size) : 0) + 1024; // + cost of any file
+    items[i].hash = content_hash_hex(normalize_path(files[i]));
+  }
+
+  // largest first to the least loaded shard
+  sort(items.begin(), items.end(), [](const Item & a, const Item & b)
+  {
+    if (a.weight != b.weight)
+      return a.weight > b.weight;
+    return a.hash != b.hash ? a.hash < b.hash : a.pos < b.pos; // file listed twice
+
+  });
+
+  vector<uint64_t> load(count, 0);
+  vector<bool> selected(files.size(), false);
+  for (const Item & item : items)
+  {
+    int shard = int(min_element(load.begin(), load.end()) - load.begin());
+    load[shard] += item.weight;
+    if (shard == index - 1)
+      selected[item.pos] = true;
+  }
+
+  vector<size_t> res;
+  for (size_t i = 0; i < files.size(); i++)
+    if (selected[i])
+      res.push_back(i);
+
+  return res;
+}
+
+
+namespace
+{
+  // reader of JSON produced by json_output.cpp
+  struct JsonReader
+  {
+    const char * p;
+    bool ok;
+
+    JsonReader(const char * text) : p(text), ok(true) {}
+
+    void skipSpaces()
+    {
+      while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    }
+
+    bool expect(char c)
+    {
+      skipSpaces();
+      if (*p != c)
+        return ok = false;
+      p++;
+      return true;
+    }
+
+    bool peek(char c)
+    {
+      skipSpaces();
+      return *p == c;
+    }
+
+    bool comma() // separator of items
+    {
+      if (!peek(','))
+        return false;
+      p++;
+      return true;
+    }
+
+    static void appendUtf8(string & s, unsigned code)
+    {
+      if (code < 0x80)
+        s += char(code);
+      else if (code < 0x800)
+      {
+        s += char(0xC0 | (code >> 6));
+        s += char(0x80 | (code & 0x3F));
+      }
+      else
+      {
+        s += char(0xE0 | (code >> 12));
+        s += char(0x80 | ((code >> 6) & 0x3F));
+        s += char(0x80 | (code & 0x3F));
+      }
+    }
+
+    string readString()
+    {
+      string s;
+      if (!expect('"'))
+        return s;
+
+      while (*p && *p != '"')
+      {
+        if (*p != '\\')
+        {
+          s += *p++;
+          continue;
+        }
+
+        p++;
+        switch (*p)
+        {
+          case 'b': s += '\b'; break;
+          case 'f': s += '\f'; break;
+          case 'n': s += '\n'; break;
+          case 'r': s += '\r'; break;
+          case 't': s += '\t'; break;
+          case 'u':
+          {
+            char hex[5] = { 0 };
+            for (int i = 0; i < 4 && p[i + 1]; i++)
+              hex[i] = p[i + 1];
+            appendUtf8(s, unsigned(strtoul(hex, nullptr, 16)));
+            p += strlen(hex);
+            break;
+          }
+          case 0: ok = false; return s;
+          default: s += *p; break;
+        }
+        p++;
+      }
+
+      if (*p != '"')
+        ok = false;
+      else
+        p++;
+
+      return s;
+    }
+
+    // number, true, false or null as text
+    string readLiteral()
+    {
+      skipSpaces();
+      const char * b = p;
+      while (*p && !strchr(",]} \t\r\n", *p))
+        p++;
+      if (b == p)
+        ok = false;
+      return string(b, p);
+    }
+
+    void skipValue()
+    {
+      skipSpaces();
+      if (*p == '"')
+        readString();
+      else if (*p == '{' || *p == '[')
+      {
+        char close = (*p == '{') ? '}' : ']';
+        p++;
+        if (peek(close))
+        {
+          p++;
+          return;
+        }
+        do
+        {
+          if (close == '}')
+          {
+            readString();
+            expect(':');
+          }
+          skipValue();
+        } while (ok && comma());
+        expect(close);
+      }
+      else
+        readLiteral();
+    }
+
+    bool readMessage(CompilerMessage & cm)
+    {
+      if (!expect('{'))
+        return false;
+
+      if (!peek('}'))
+        do
+        {
+          string key = readString();
+          expect(':');
+          if (key == "line")
+            cm.line = atoi(readLiteral().c_str());
+          else if (key == "col")
+            cm.column = atoi(readLiteral().c_str());
+          else if (key == "intId")
+            cm.intId = atoi(readLiteral().c_str());
+          else if (key == "isError")
+            cm.isError = (readLiteral() == "true");
+          else if (key == "file")
+            cm.fileName = readString();
+          else if (key == "message")
+            cm.message = readString();
+          else
+            skipValue(); // textId is restored from intId
+        } while (ok && comma());
+
+      cm.textId = cm.isError ? "" : CompilationContext::findWarningTextId(cm.intId);
+      return expect('}');
+    }
+  };
+}
+
+
+bool read_messages_json(const string & file_name, vector<CompilerMessage> & messages)
+{
+  FILE * f = fopen(file_name.c_str(), "rb");
+  if (!f)
+    return false;
+
+  string text;
+  char buf[16384];
+  size_t n = 0;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    text.append(buf, n);
+  fclose(f);
+
+  JsonReader reader(text.c_str());
+  if (!reader.expect('{'))
+    return false;
+
+  if (!reader.peek('}'))
+    do
+    {
+      string key = reader.readString();
+      reader.expect(':');
+      if (key != "messages")
+      {
+        reader.skipValue();
+        continue;
+      }
+
+      reader.expect('[');
+      if (!reader.peek(']'))
+        do
+        {
+          CompilerMessage cm;
+          if (reader.readMessage(cm))
+            messages.push_back(cm);
+        } while (reader.ok && reader.comma());
+      reader.expect(']');
+    } while (reader.ok && reader.comma());
+
+  reader.expect('}');
+  return reader.ok;
+}
+
+
+bool merge_result_files(const vector<string> & file_names, OutputMode output_mode, const vector<string> & input_files)
+{
+  bool res = true;
+  vector<CompilerMessage> allMessages;
+  vector<size_t> msgShard; // index of result file of each message
+  for (size_t k = 0; k < file_names.size(); k++)
+  {
+    const string & fileName = file_names[k];
+    vector<CompilerMessage> messages;
+    if (!read_messages_json(fileName, messages))
+    {
+      CompilationContext::globalError((string("Cannot read results from '") + fileName + "'").c_str());
+      res = false;
+      continue;
+    }
+
+    allMessages.insert(allMessages.end(), messages.begin(), messages.end());
+    msgShard.resize(allMessages.size(), k);
+  }
+
+  // each file is analyzed by one shard, so ordering by files restores the order of a single run.
+  // A file listed twice can be analyzed by two shards, its later occurrence reports a subset of messages
+  // (never-declared ones drop out as declarations accumulate), so the shard with more messages goes first.
+  if (!input_files.empty())
+  {
+    map<string, size_t> filePos;
+    for (size_t i = 0; i < input_files.size(); i++)
+      filePos.insert(make_pair(normalize_path(input_files[i]), i));
+
+    vector<size_t> msgPos(allMessages.size());
+    for (size_t i = 0; i < allMessages.size(); i++)
+    {
+      auto it = filePos.find(normalize_path(allMessages[i].fileName));
+      msgPos[i] = it != filePos.end() ? it->second : input_files.size();
+    }
+
+    map<pair<size_t, size_t>, size_t> shardFileMessages;
+    for (size_t i = 0; i < allMessages.size(); i++)
+      shardFileMessages[make_pair(msgPos[i], msgShard[i])]++;
+
+    vector<size_t> order(allMessages.size());
+    for (size_t i = 0; i < order.size(); i++)
+      order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+      {
+        if (msgPos[a] != msgPos[b])
+          return msgPos[a] < msgPos[b];
+        return shardFileMessages[make_pair(msgPos[a], msgShard[a])] > shardFileMessages[make_pair(msgPos[b], msgShard[b])];
+      });
+
+    vector<CompilerMessage> sorted;
+    sorted.reserve(allMessages.size());
+    for (size_t i : order)
+      sorted.push_back(allMessages[i]);
+    allMessages.swap(sorted);
+  }
+
+  for (const CompilerMessage & cm : allMessages)
+    CompilationContext::publish(CompilationContext::eventFromMessage(cm, output_mode));
+
+  return res;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "compilation_context.h"
+
+
+// Splitting of input files between CI agents and merging of their results
+
+// indices of files of shard 'index' (1-based) of 'count', in the order of input list. Shards are balanced by file
+// sizes, ties are resolved by hash of normalized path, so every agent gets the same split for the same checkout.
+std::vector<size_t> select_shard_files(const std::vector<std::string> & files, int index, int count);
+
+// parses JSON written by --message-output-file, false if file cannot be read or parsed
+bool read_messages_json(const std::string & file_name, std::vector<CompilerMessage> & messages);
+
+// publishes messages of all files, deduplicated as in a single run. Messages are ordered by input_files
+// (the unsharded input list) if it is not empty, otherwise they are in the order of result files.
+bool merge_result_files(const std::vector<std::string> & file_names, OutputMode output_mode,
+  const std::vector<std::string> & input_files);
@@ -0,0 +1,156 @@
+#include "source_job.h"
+#include <string.h>
+
+using namespace std;
+
+
+static const char source_job_magic[] = "QSAJOB01";
+
+
+static void write_int(string & out, int64_t value)
+{
+  for (int i = 0; i < 8; i++)
+    out += char((uint64_t(value) >> (i * 8)) & 0xFF);
+}
+
+static void write_string(string & out, const string & str)
+{
+  write_int(out, int64_t(str.length()));
+  out += str;
+}
+
+
+struct JobReader
+{
+  const char * ptr;
+  const char * end;
+  bool ok;
+
+  JobReader(const char * data, size_t size) : ptr(data), end(data + size), ok(true) {}
+
+  int64_t readInt()
+  {
+    if (end - ptr < 8)
+    {
+      ok = false;
+      return 0;
+    }
+
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+      value = (value << 8) | (unsigned char)ptr[i];
+    ptr += 8;
+    return int64_t(value);
+  }
+
+  string readString()
+  {
+    int64_t len = readInt();
+    if (!ok || len < 0 || len > end - ptr)
+    {
+      ok = false;
+      return string();
+    }
+
+    string res(ptr, size_t(len));
+    ptr += len;
+    return res;
+  }
+};
+
+
+void serialize_source_job(const SourceJob & job, string & out)
+{
+  out.append(source_job_magic, sizeof(source_job_magic) - 1);
+  write_int(out, job.result);
+  write_int(out, job.analysisOk);
+  write_int(out, job.expectError);
+  write_int(out, job.expectWarningNumber);
+  write_int(out, job.isError);
+
+  write_int(out, int64_t(job.declared.size()));
+  for (const string & name : job.declared)
+    write_string(out, name);
+
+  write_int(out, int64_t(job.report.events.size()));
+  for (const ReportedEvent & ev : job.report.events)
+  {
+    write_int(out, ev.type);
+    write_int(out, ev.errorLevel);
+    write_string(out, ev.hash);
+    write_string(out, ev.text);
+    write_string(out, ev.requiresUndeclared);
+    write_int(out, ev.cm.line);
+    write_int(out, ev.cm.column);
+    write_int(out, ev.cm.intId);
+    write_string(out, ev.cm.message);
+    write_string(out, ev.cm.fileName);
+    write_int(out, ev.cm.isError);
+  }
+}
+
+
+bool deserialize_source_job(const char * data, size_t size, SourceJob & job)
+{
+  size_t magicLen = sizeof(source_job_magic) - 1;
+  if (size < magicLen || memcmp(data, source_job_magic, magicLen) != 0)
+    return false;
+
+  JobReader reader(data + magicLen, size - magicLen);
+  job.result = int(reader.readInt());
+  job.analysisOk = reader.readInt() != 0;
+  job.expectError = reader.readInt() != 0;
+  job.expectWarningNumber = int(reader.readInt());
+  job.isError = reader.readInt() != 0;
+
+  job.declared.clear();
+  int64_t declaredCount = reader.readInt();
+  for (int64_t i = 0; i < declaredCount && reader.ok; i++)
+    job.declared.insert(reader.readString());
+
+  job.report.events.clear();
+  int64_t eventCount = reader.readInt();
+  for (int64_t i = 0; i < eventCount && reader.ok; i++)
+  {
+    ReportedEvent ev;
+    ev.type = ReportedEventType(reader.readInt());
+    ev.errorLevel = int(reader.readInt());
+    ev.hash = reader.readString();
+    ev.text = reader.readString();
+    ev.requiresUndeclared = reader.readString();
+    ev.cm.line = int(reader.readInt());
+    ev.cm.column = int(reader.readInt());
+    ev.cm.intId = int(reader.readInt());
+    ev.cm.message = reader.readString();
+    ev.cm.fileName = reader.readString();
+    ev.cm.isError = reader.readInt() != 0;
+    ev.cm.textId = ev.cm.isError ? "" : CompilationContext::findWarningTextId(ev.cm.intId);
+    job.report.events.push_back(ev);
+  }
+
+  return reader.ok && reader.ptr == reader.end;
+}
+
+
+void serialize_cache_entry(const string & key, const SourceJob & job, string & out)
+{
+  write_string(out, key);
+  write_string(out, job.fileName);
+  serialize_source_job(job, out);
+}
+
+
+bool deserialize_cache_entry(const char * data, size_t size, const string & key, SourceJob & job)
+{
+  JobReader reader(data, size);
+  if (reader.readString() != key || reader.readString() != job.fileName || !reader.ok)
+    return false;
+
+  SourceJob cached;
+  if (!deserialize_source_job(reader.ptr, size_t(reader.end - reader.ptr), cached))
+    return false;
+
+  cached.fileName = job.fileName;
+  job = cached;
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include "compilation_context.h"
+
+
+// Analysis of a single file running on a worker thread, its output is published in the order of input files
+struct SourceJob
+{
+  std::string fileName;
+  FileReport report;
+  std::set<std::string> declared; // identifiers for ever_declared, added on publish
+  int result; // < 0 if expectations must be checked after publishing
+  bool analysisOk;
+  bool expectError;
+  int expectWarningNumber;
+  bool isError;
+  int tokenCount; // estimated cost for scheduling of the next runs, 0 if file was not lexed
+  std::shared_ptr<SourceText> source; // input read by the reading stage, released after analysis
+  std::string sqconfig; // found by the reading stage
+
+  SourceJob()
+  {
+    result = 0;
+    analysisOk = true;
+    expectError = false;
+    expectWarningNumber = 0;
+    isError = false;
+    tokenCount = 0;
+  }
+};
+
+// Binary form of the analysis result of a job (everything except fileName, tokenCount and input), used by result caches
+void serialize_source_job(const SourceJob & job, std::string & out);
+bool deserialize_source_job(const char * data, size_t size, SourceJob & job); // false if data is corrupted
+
+// Entry of result caches: the analysis result with the key and the file name it was stored for. A loaded entry
+// is used only if both match the request, so a wrong answer of a shared cache is never replayed.
+void serialize_cache_entry(const std::string & key, const SourceJob & job, std::string & out);
+bool deserialize_cache_entry(const char * data, size_t size, const std::string & key, SourceJob & job); // job.fileName must be set
@@ -0,0 +1,169 @@
+#include "source_text.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdint.h>
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+using namespace std;
+
+
+bool SourceText::mapFiles = true;
+
+
+SourceText::SourceText() : data(""), size(0), mapping(nullptr), mappingSize(0), maskEnd(0)
+{
+}
+
+
+SourceText::~SourceText()
+{
+  unmap();
+}
+
+
+void SourceText::unmap()
+{
+#if !defined(_WIN32)
+  if (mapping)
+    munmap(mapping, mappingSize);
+#endif
+  mapping = nullptr;
+  mappingSize = 0;
+}
+
+
+bool SourceText::load(const string & file_name)
+{
+  unmap();
+  storage.clear();
+  keptRanges.clear();
+  maskEnd = 0;
+  data = "";
+  size = 0;
+
+#if defined(_WIN32)
+  // text mode translates line endings, keep it the same as before
+  ifstream tmp(file_name);
+  if (tmp.fail())
+    return false;
+  storage.assign((std::istreambuf_iterator<char>(tmp)), std::istreambuf_iterator<char>());
+#else
+  int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+  {
+    // zero-filled tail of the last page is the '\0' terminator, so the size must not be page-aligned
+    size_t fileSize = size_t(st.st_size);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (mapFiles && pageSize > 0 && fileSize % size_t(pageSize) != 0)
+    {
+      void * p = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED)
+      {
+        close(fd);
+        mapping = p;
+        mappingSize = fileSize;
+        data = (const char *)p;
+        size = fileSize;
+        return true;
+      }
+    }
+    storage.reserve(fileSize);
+  }
+
+  char buf[65536];
+  for (;;)
+  {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    storage.append(buf, size_t(n));
+  }
+  close(fd);
+#endif
+
+  data = storage.c_str();
+  size = storage.length();
+  return true;
+}
+
+
+void SourceText::assign(const string & text)
+{
+  unmap();
+  keptRanges.clear();
+  maskEnd = 0;
+  storage = text;
+  data = storage.c_str();
+  size = storage.length();
+}
+
+
+void SourceText::view(const char * text, size_t length)
+{
+  unmap();
+  storage.clear();
+  keptRanges.clear();
+  maskEnd = 0;
+  data = text;
+  size = length;
+}
+
+
+void SourceText::prefault() const
+{
+#if !defined(_WIN32)
+  if (!mapping)
+    return;
+
+  madvise(mapping, mappingSize, MADV_WILLNEED);
+
+  long pageSize = sysconf(_SC_PAGESIZE);
+  volatile char sum = 0;
+  for (size_t i = 0; i < mappingSize; i += size_t(pageSize > 0 ? pageSize : 4096))
+    sum += data[i];
+  (void)sum;
+#endif
+}
+
+
+bool SourceText::hasUtf8Bom() const
+{
+  return size >= 3 && uint8_t((*this)[0]) == 0xEF && uint8_t((*this)[1]) == 0xBB && uint8_t((*this)[2]) == 0xBF;
+}
+
+
+char SourceText::maskedChar(size_t i) const
+{
+  char ch = data[i];
+  auto it = upper_bound(keptRanges.begin(), keptRanges.end(), make_pair(i, size_t(-1)));
+  if (it != keptRanges.begin() && i < (it - 1)->second)
+    return ch;
+
+  return (ch == '\n' || ch == '\r') ? ch : ' ';
+}
+
+
+void SourceText::mask(const char * end, const vector<pair<const char *, const char *>> & kept)
+{
+  if (end <= data || end > data + size)
+    return;
+
+  maskEnd = max(maskEnd, size_t(end - data));
+  for (auto && range : kept)
+    if (range.first >= data && range.first < range.second)
+      keptRanges.push_back(make_pair(size_t(range.first - data), size_t(range.second - data)));
+
+  sort(keptRanges.begin(), keptRanges.end());
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+
+// Read-only source code of a module. Files are mapped into memory where possible, so the code is not
+// copied. Text is always followed by '\0'. Import statements are masked: operator[] reads them as spaces
+// (line breaks are kept), the underlying buffer is never modified.
+class SourceText
+{
+  const char * data;
+  size_t size;
+  std::string storage; // used when the text is not mapped and not viewed
+  void * mapping;
+  size_t mappingSize;
+
+  size_t maskEnd; // chars in [0, maskEnd) are masked, except kept ranges
+  std::vector<std::pair<size_t, size_t>> keptRanges; // sorted, .second is not inclusive
+
+  char maskedChar(size_t i) const;
+  void unmap();
+
+  SourceText(const SourceText &) = delete;
+  SourceText & operator=(const SourceText &) = delete;
+
+public:
+  SourceText();
+  ~SourceText();
+
+  // mapped file which is truncated by another process raises SIGBUS on access, so files which may be changed
+  // while they are analyzed (--watch, --server) are read instead
+  static bool mapFiles;
+
+  bool load(const std::string & file_name);
+  void assign(const std::string & text); // copies text
+  // no copy, text must be '\0'-terminated, it must outlive this object and must not be changed
+  void view(const char * text, size_t length);
+  void view(const std::string & text) { view(text.c_str(), text.length()); }
+
+  const char * c_str() const { return data; } // raw text, masked ranges are not applied
+  size_t length() const { return size; }
+  bool empty() const { return size == 0; }
+  bool isMapped() const { return mapping != nullptr; }
+  void prefault() const; // pages of mapped file are read now, not on the first access by the lexer
+  bool hasUtf8Bom() const;
+
+  char operator[](size_t i) const
+  {
+    return i < maskEnd ? maskedChar(i) : data[i];
+  }
+
+  // [c_str(), end) except kept ranges will be read as spaces, pointers point into c_str()
+  void mask(const char * end, const std::vector<std::pair<const char *, const char *>> & kept);
+};
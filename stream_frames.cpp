@@ -0,0 +1,65 @@
+#include "stream_frames.h"
+
+#include <string.h>
+
+using namespace std;
+
+
+static const uint32_t max_frame_size = 0x7fffffff;
+
+
+bool is_stream_frames_header(const char * data, size_t size)
+{
+  return size >= STREAM_FRAMES_HEADER_SIZE && !memcmp(data, STREAM_FRAMES_MAGIC, STREAM_FRAMES_MAGIC_SIZE);
+}
+
+
+void write_stream_frames_header(string & out)
+{
+  out.append(STREAM_FRAMES_MAGIC, STREAM_FRAMES_MAGIC_SIZE);
+  out += char(STREAM_FRAMES_VERSION);
+}
+
+
+void write_stream_frame(string & out, int type, const char * data, size_t size)
+{
+  uint32_t length = uint32_t(size);
+  char header[5] = { char(type), char(length & 0xff), char((length >> 8) & 0xff), char((length >> 16) & 0xff),
+    char((length >> 24) & 0xff) };
+  out.append(header, sizeof(header));
+  out.append(data, size);
+}
+
+
+bool read_stream_frame(FILE * in, StreamFrame & frame, bool & corrupted)
+{
+  corrupted = false;
+  unsigned char header[5];
+  size_t n = fread(header, 1, sizeof(header), in);
+  if (n == 0)
+    return false;
+
+  if (n < sizeof(header))
+  {
+    corrupted = true;
+    return false;
+  }
+
+  uint32_t length = uint32_t(header[1]) | (uint32_t(header[2]) << 8) | (uint32_t(header[3]) << 16) |
+    (uint32_t(header[4]) << 24);
+  if (length > max_frame_size)
+  {
+    corrupted = true;
+    return false;
+  }
+
+  frame.type = header[0];
+  frame.payload.resize(length);
+  if (length && fread(&frame.payload[0], 1, length, in) != length)
+  {
+    corrupted = true;
+    return false;
+  }
+
+  return true;
+}
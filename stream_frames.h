@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+
+
+// Binary stream format: header "QSASTRM" + version byte, then frames. Frame is a type byte,
+// payload length (uint32, little endian) and payload. Sources are described by frames in the same order
+// as sections of the text stream format: SF_FILE_NAME starts a new source, then optional SF_SQCONFIG and
+// trusted identifiers (one 'parent' or 'parent.child' per frame), SF_CODE finishes the source.
+
+#define STREAM_FRAMES_MAGIC "QSASTRM"
+#define STREAM_FRAMES_MAGIC_SIZE 7
+#define STREAM_FRAMES_VERSION 1
+#define STREAM_FRAMES_HEADER_SIZE (STREAM_FRAMES_MAGIC_SIZE + 1)
+
+enum StreamFrameType
+{
+  SF_FILE_NAME = 1,
+  SF_SQCONFIG = 2,
+  SF_TRUSTED_LOCAL = 3,
+  SF_TRUSTED_GLOBAL = 4,
+  SF_TRUSTED_CONST = 5,
+  SF_CODE = 6, // empty code means that file will be read from disk
+
+  // analyzer server only
+  SF_RESET = 16, // drop cached configs and exports
+  SF_EXIT = 17, // stop the server, or the worker of distributed analysis
+  SF_RESPONSE = 32, // JSON response to SF_CODE or SF_RESET
+
+  // distributed analysis, see distributed.h
+  SF_WORKER_HELLO = 48, // digest of run inputs and number of worker threads, separated by '\n'
+  SF_WORKER_REJECTED = 49, // reason, the worker stops
+  SF_WORK = 50, // file index (uint64, little endian) and file name
+  SF_WORK_RESULT = 51, // file index (uint64, little endian) and serialized job
+};
+
+struct StreamFrame
+{
+  int type;
+  std::string payload;
+};
+
+bool is_stream_frames_header(const char * data, size_t size); // size is at least STREAM_FRAMES_HEADER_SIZE
+void write_stream_frames_header(std::string & out);
+void write_stream_frame(std::string & out, int type, const char * data, size_t size);
+
+// Reads the next frame, payload is read directly into frame.payload.
+// Returns false at the end of input, 'corrupted' is set if input ends inside a frame or length is invalid.
+bool read_stream_frame(FILE * in, StreamFrame & frame, bool & corrupted);
@@ -0,0 +1,340 @@
+#include "tcp_connection.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(_WIN32)
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#  define close_socket closesocket
+#  define SHUT_RDWR SD_BOTH
+#  define SEND_FLAGS 0
+#else
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <netdb.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <sys/time.h>
+#  include <sys/select.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+#  define close_socket ::close
+#  if defined(MSG_NOSIGNAL)
+#    define SEND_FLAGS MSG_NOSIGNAL
+#  else
+#    define SEND_FLAGS 0
+#  endif
+#endif
+
+using namespace std;
+
+
+static const int default_timeout_sec = 60;
+
+static void set_socket_options(intptr_t s)
+{
+  // requests are sent in batches, there is nothing to wait for
+  int noDelay = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+
+  int keepAlive = 1;
+  setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, (const char *)&keepAlive, sizeof(keepAlive));
+
+#if defined(SO_NOSIGPIPE)
+  // where send() has no MSG_NOSIGNAL, a closed peer must not kill the process with SIGPIPE
+  int noSigPipe = 1;
+  setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char *)&noSigPipe, sizeof(noSigPipe));
+#endif
+}
+
+
+static void set_non_blocking(intptr_t s, bool non_blocking)
+{
+#if defined(_WIN32)
+  u_long mode = non_blocking ? 1 : 0;
+  ioctlsocket(s, FIONBIO, &mode);
+#else
+  int flags = fcntl(int(s), F_GETFL, 0);
+  fcntl(int(s), F_SETFL, non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+}
+
+
+static bool connect_with_timeout(intptr_t s, const sockaddr * address, int address_len, int timeout_sec)
+{
+  set_non_blocking(s, true);
+  if (::connect(s, address, address_len) != 0)
+  {
+#if defined(_WIN32)
+    if (WSAGetLastError() != WSAEWOULDBLOCK)
+      return false;
+#else
+    if (errno != EINPROGRESS)
+      return false;
+#endif
+
+    // failed connection is reported as writable on POSIX and as exception on Windows
+    fd_set writeSet;
+    fd_set exceptSet;
+    FD_ZERO(&writeSet);
+    FD_ZERO(&exceptSet);
+    FD_SET(s, &writeSet);
+    FD_SET(s, &exceptSet);
+    timeval timeout = { timeout_sec, 0 };
+    if (select(int(s + 1), nullptr, &writeSet, &exceptSet, &timeout) <= 0)
+      return false;
+
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char *)&error, &errorLen) != 0 || error != 0)
+      return false;
+  }
+
+  set_non_blocking(s, false);
+  return true;
+}
+
+
+static void init_sockets()
+{
+#if defined(_WIN32)
+  static bool initialized = false;
+  if (!initialized)
+  {
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+    initialized = true;
+  }
+#endif
+}
+
+
+TcpConnection::TcpConnection() : sock(-1), inPos(0)
+{
+}
+
+
+TcpConnection::~TcpConnection()
+{
+  close();
+}
+
+
+bool TcpConnection::connect(const string & host, int port)
+{
+  close();
+  init_sockets();
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo * addresses = nullptr;
+  if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses) != 0)
+    return false;
+
+  for (addrinfo * a = addresses; a && sock == -1; a = a->ai_next)
+  {
+    intptr_t s = intptr_t(socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+    if (s == -1)
+      continue;
+
+    if (!connect_with_timeout(s, a->ai_addr, int(a->ai_addrlen), default_timeout_sec))
+    {
+      close_socket(s);
+      continue;
+    }
+
+    set_socket_options(s);
+    sock = s;
+    setTimeout(default_timeout_sec);
+  }
+
+  freeaddrinfo(addresses);
+  return sock != -1;
+}
+
+
+void TcpConnection::close()
+{
+  if (sock != -1)
+    close_socket(sock);
+  sock = -1;
+  inBuffer.clear();
+  inPos = 0;
+}
+
+
+void TcpConnection::setTimeout(int seconds)
+{
+  if (sock == -1)
+    return;
+
+#if defined(_WIN32)
+  DWORD timeout = seconds * 1000;
+#else
+  timeval timeout = { seconds, 0 };
+#endif
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+}
+
+
+void TcpConnection::shutdown()
+{
+  if (sock != -1)
+    ::shutdown(sock, SHUT_RDWR);
+}
+
+
+bool TcpConnection::sendAll(const char * data, size_t size)
+{
+  if (sock == -1)
+    return false;
+
+  while (size > 0)
+  {
+    int n = int(::send(sock, data, int(min(size, size_t(1) << 20)), SEND_FLAGS));
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= size_t(n);
+  }
+
+  return true;
+}
+
+
+bool TcpConnection::fillBuffer()
+{
+  if (sock == -1)
+    return false;
+
+  if (inPos > 0)
+  {
+    inBuffer.erase(0, inPos);
+    inPos = 0;
+  }
+
+  char buf[65536];
+  int n = int(::recv(sock, buf, int(sizeof(buf)), 0));
+  if (n <= 0)
+    return false;
+
+  inBuffer.append(buf, size_t(n));
+  return true;
+}
+
+
+bool TcpConnection::readLine(string & line)
+{
+  for (;;)
+  {
+    size_t eol = inBuffer.find('\n', inPos);
+    if (eol != string::npos)
+    {
+      line.assign(inBuffer, inPos, eol - inPos);
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+      inPos = eol + 1;
+      return true;
+    }
+
+    if (!fillBuffer())
+      return false;
+  }
+}
+
+
+bool TcpConnection::readExact(size_t size, string & out)
+{
+  while (inBuffer.size() - inPos < size)
+    if (!fillBuffer())
+      return false;
+
+  out.assign(inBuffer, inPos, size);
+  inPos += size;
+  return true;
+}
+
+
+TcpListener::TcpListener() : sock(-1)
+{
+}
+
+
+TcpListener::~TcpListener()
+{
+  close();
+}
+
+
+bool TcpListener::listen(const string & address, int port)
+{
+  close();
+  init_sockets();
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  addrinfo * addresses = nullptr;
+  if (getaddrinfo(address.c_str(), to_string(port).c_str(), &hints, &addresses) != 0)
+    return false;
+
+  for (addrinfo * a = addresses; a && sock == -1; a = a->ai_next)
+  {
+    intptr_t s = intptr_t(socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+    if (s == -1)
+      continue;
+
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+    if (::bind(s, a->ai_addr, int(a->ai_addrlen)) != 0 || ::listen(s, 16) != 0)
+    {
+      close_socket(s);
+      continue;
+    }
+
+    sock = s;
+  }
+
+  freeaddrinfo(addresses);
+  return sock != -1;
+}
+
+
+void TcpListener::close()
+{
+  if (sock != -1)
+    close_socket(sock);
+  sock = -1;
+}
+
+
+bool TcpListener::accept(TcpConnection & conn, int timeout_ms)
+{
+  if (sock == -1)
+    return false;
+
+  fd_set readSet;
+  FD_ZERO(&readSet);
+  FD_SET(sock, &readSet);
+  timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+  if (select(int(sock + 1), &readSet, nullptr, nullptr, &timeout) <= 0)
+    return false;
+
+  intptr_t s = intptr_t(::accept(sock, nullptr, nullptr));
+  if (s == -1)
+    return false;
+
+  set_socket_options(s);
+  conn.close();
+  conn.sock = s;
+  return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Blocking TCP connection with buffered reading
+class TcpConnection
+{
+  intptr_t sock; // -1 if not connected
+  std::string inBuffer;
+  size_t inPos;
+
+  bool fillBuffer();
+
+  TcpConnection(const TcpConnection &) = delete;
+  TcpConnection & operator=(const TcpConnection &) = delete;
+
+  friend class TcpListener;
+
+public:
+  TcpConnection();
+  ~TcpConnection();
+
+  bool connect(const std::string & host, int port); // with timeout of 60 seconds
+  void close();
+  bool isOpen() const { return sock != -1; }
+  void setTimeout(int seconds); // sending and reading fail after this time, 0 - wait forever
+  void shutdown(); // wakes up blocked sending and reading, the connection must be closed after that
+
+  // sending and reading may run on different threads, errors do not close the connection
+  bool sendAll(const char * data, size_t size);
+  bool sendAll(const std::string & data) { return sendAll(data.data(), data.size()); }
+  bool readLine(std::string & line); // without "\r\n"
+  bool readExact(size_t size, std::string & out);
+};
+
+
+// Listening TCP socket of servers
+class TcpListener
+{
+  intptr_t sock;
+
+  TcpListener(const TcpListener &) = delete;
+  TcpListener & operator=(const TcpListener &) = delete;
+
+public:
+  TcpListener();
+  ~TcpListener();
+
+  bool listen(const std::string & address, int port); // e.g. "127.0.0.1" for local clients, "0.0.0.0" for all
+  void close();
+  // false if there were no connections during timeout, accepted connections have no timeout
+  bool accept(TcpConnection & conn, int timeout_ms);
+};
@@ -0,0 +1,299 @@
+#!/bin/bash
+# End-to-end tests of run modes (caches, sharding, streams, server), each mode must give the same output
+# as a plain run. Usage: run_mode_tests.sh [analyzer executable]
+
+analyzer=$(command -v "${1:-sq3_static_analyzer}")
+if [ -z "$analyzer" ]
+then
+  echo "FAIL: analyzer executable not found"
+  exit 1
+fi
+[[ $analyzer == /* ]] || analyzer="$PWD/$analyzer"
+
+tests_dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+failed=""
+
+fail()
+{
+  echo "FAIL: $1"
+  failed="$failed $1"
+}
+
+# same output and exit code of two runs: same_run <test name> <expected output> <expected exit code> <output> <exit code>
+same_run()
+{
+  if ! cmp -s "$2" "$4"
+  then
+    fail "$1 (output differs)"
+    diff "$2" "$4" | head -20
+  elif [ "$3" != "$5" ]
+  then
+    fail "$1 (exit code $5, expected $3)"
+  fi
+}
+
+
+# console squirrel stand-in, prints root table of an empty VM
+cat > csq <<'END_OF_CSQ'
+#!/bin/bash
+for name in print assert array type require getroottable getconsttable
+do
+  echo ".R. $name"
+done
+END_OF_CSQ
+chmod +x csq
+
+# sources: global enum in predefinition file, globals declared by one file and used by the next ones,
+# unused locals and globals which are never declared (never-declared depends on order of files)
+mkdir -p src/a src/b
+printf 'global enum Color { RED GREEN }\nglobal const LIMIT = 10\n' > src/pre.nut
+for i in 1 2 3 4 5 6 7 8
+do
+  dir=$([ $i -le 4 ] && echo a || echo b)
+  printf "::decl_$i <- Color.RED\nlocal used$i = ::decl_$(( i == 1 ? 8 : i - 1 ))\nlocal unused$i = LIMIT\nreturn used$i + undeclared_$i + late_decl\n" \
+    > src/$dir/file$i.nut
+done
+printf '::late_decl <- 1\n' > src/b/last.nut
+echo src/pre.nut > pre.txt
+find src -name "*.nut" ! -name pre.nut | sort > files.txt
+
+common_args="--csq-exe:$work/csq -w242 -w252 --predefinition-files:pre.txt"
+args="$common_args --files:files.txt"
+
+"$analyzer" $args > plain.txt
+plain_rc=$?
+grep -q "declared-never-used" plain.txt || fail "plain run (no unused variables reported)"
+grep -q "never-declared" plain.txt || fail "plain run (no never-declared globals reported)"
+
+
+# result cache with global enum in predefinition files
+"$analyzer" $args --cache-dir:cache > cache_cold.txt
+same_run "cache, cold" plain.txt $plain_rc cache_cold.txt $?
+"$analyzer" $args --cache-dir:cache > cache_warm.txt
+same_run "cache, warm" plain.txt $plain_rc cache_warm.txt $?
+[ -n "$(find cache -name '*.qsa')" ] || fail "cache (no entries stored)"
+
+
+# shards merged into the result of a single run, globals of files of other shards are declared;
+# file listed twice is analyzed at both positions
+"$analyzer" $args --message-output-file:plain.json > /dev/null
+{ cat files.txt; head -1 files.txt; } > files_dup.txt
+for list in files.txt files_dup.txt
+do
+  "$analyzer" $common_args --files:$list --message-output-file:list_plain.json > /dev/null
+  for n in 2 3 5
+  do
+    merge_args=""
+    for i in $(seq 1 $n)
+    do
+      "$analyzer" $common_args --files:$list --shard:$i/$n --message-output-file:shard_$i.json > /dev/null
+      merge_args="$merge_args --merge-results:shard_$i.json"
+    done
+    "$analyzer" --files:$list $merge_args --message-output-file:merged.json > /dev/null
+    same_run "shard+merge, $list, $n shards" list_plain.json 0 merged.json 0
+  done
+done
+
+
+# journal: complete journal is replayed, journal of a killed run (cut in the middle of a record) is resumed
+"$analyzer" $args --journal:run.journal > journal_first.txt
+same_run "journal, first run" plain.txt $plain_rc journal_first.txt $?
+"$analyzer" $args --journal:run.journal > journal_replay.txt
+same_run "journal, replay" plain.txt $plain_rc journal_replay.txt $?
+head -c $(( $(stat -c %s run.journal) / 2 )) run.journal > cut.journal
+mv cut.journal run.journal
+"$analyzer" $args --journal:run.journal > journal_resume.txt
+same_run "journal, resumed" plain.txt $plain_rc journal_resume.txt $?
+
+
+# directory walk, files are analyzed in the order of the sorted list
+"$analyzer" $common_args --dir:src --exclude-file:pre.nut > dir.txt
+same_run "dir" plain.txt $plain_rc dir.txt $?
+
+
+# watch: changed file sees only declarations of files before it, as in a single run over all files
+if [ "$(uname)" == "Linux" ]
+then
+  head -1 files.txt > first_file.txt
+  "$analyzer" $common_args --files:first_file.txt > first_file.txt.out
+  "$analyzer" $args --watch > watch.txt 2>&1 &
+  watch_pid=$!
+  for i in $(seq 1 100)
+  do
+    grep -q "Watching for changes" watch.txt && break
+    sleep 0.1
+  done
+  first_file=$(cat first_file.txt)
+  cp "$first_file" first_file.nut
+  cat first_file.nut > "$first_file"
+  for i in $(seq 1 100)
+  do
+    grep -q "^Analyzed" watch.txt && break
+    sleep 0.1
+  done
+  kill $watch_pid
+  wait $watch_pid 2> /dev/null
+  sed -n '/^Watching for changes/,/^Analyzed/p' watch.txt | sed '1d;$d' > watch_pass.txt
+  grep -q "^Analyzed 1 changed file" watch.txt || fail "watch (changed file is not analyzed)"
+  same_run "watch" first_file.txt.out 0 watch_pass.txt 0
+fi
+
+
+if ! command -v python3 > /dev/null
+then
+  echo "python3 not found, tests of streams, server and remote cache are skipped"
+else
+
+# stream_tool.py make <files list> <text stream> <binary stream> <text server request> <binary server request>
+# stream_tool.py text <binary server response> - prints frames as responses of the text protocol
+# stream_tool.py send <unix socket> <request file> - prints the response
+# stream_tool.py hang <coordinator port> - prints its port, takes the handshake of a worker connected to it,
+#   then connects to the coordinator as that worker and never sends results
+cat > stream_tool.py <<'END_OF_TOOL'
+import socket, struct, sys, time
+
+def frame(frame_type, payload):
+    return bytes([frame_type]) + struct.pack("<I", len(payload)) + payload
+
+if sys.argv[1] == "make":
+    text, binary, text_request, request = "", b"QSASTRM\x01", "", b"QSASTRM\x01"
+    for i, name in enumerate(open(sys.argv[2]).read().split()):
+        code = open(name, "rb").read() if i % 2 == 0 else b"" # empty code is read from disk
+        text += "###[FILE_NAME]" + name + "\n###[CODE]\n" + code.decode()
+        text_request += "###[FILE_NAME]" + name + "\n###[CODE]\n" + code.decode() + "###[END]\n"
+        binary += frame(1, name.encode()) + frame(6, code)
+        request += frame(1, name.encode()) + frame(6, code)
+    open(sys.argv[3], "w").write(text)
+    open(sys.argv[4], "wb").write(binary)
+    open(sys.argv[5], "w").write(text_request + "###[EXIT]\n")
+    open(sys.argv[6], "wb").write(request + frame(17, b""))
+elif sys.argv[1] == "text":
+    data, pos = open(sys.argv[2], "rb").read(), 0
+    while pos < len(data):
+        size = struct.unpack("<I", data[pos + 1 : pos + 5])[0]
+        sys.stdout.write(data[pos + 5 : pos + 5 + size].decode() + "\n###[END]\n")
+        pos += 5 + size
+elif sys.argv[1] == "send":
+    for attempt in range(100):
+        try:
+            conn = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            conn.connect(sys.argv[2])
+            break
+        except OSError:
+            time.sleep(0.1)
+    conn.sendall(open(sys.argv[3], "rb").read())
+    conn.shutdown(socket.SHUT_WR)
+    while True:
+        data = conn.recv(65536)
+        if not data:
+            break
+        sys.stdout.buffer.write(data)
+elif sys.argv[1] == "hang":
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(1)
+    print(listener.getsockname()[1], flush=True)
+    worker = listener.accept()[0].makefile("rb")
+    handshake = worker.read(8 + 5)
+    handshake += worker.read(struct.unpack("<I", handshake[-4:])[0])
+    worker.close()
+    conn = socket.create_connection(("127.0.0.1", int(sys.argv[2])))
+    conn.sendall(handshake)
+    while conn.recv(65536):
+        pass
+END_OF_TOOL
+
+python3 stream_tool.py make files.txt stream.txt stream.bin request.txt request.bin
+stream_args="--csq-exe:$work/csq -w242 -w252" # streams and server requests are analyzed without predefinition files
+
+# text and binary streams, from file and from stdin
+"$analyzer" $stream_args --files:files.txt > plain_no_predefinition.txt
+plain_no_predefinition_rc=$?
+"$analyzer" $stream_args --stream:stream.txt > stream_text.txt
+same_run "stream, text" plain_no_predefinition.txt $plain_no_predefinition_rc stream_text.txt $?
+"$analyzer" $stream_args --stream:stream.bin > stream_binary.txt
+same_run "stream, binary" plain_no_predefinition.txt $plain_no_predefinition_rc stream_binary.txt $?
+"$analyzer" $stream_args --stream:- < stream.bin > stream_stdin.txt
+same_run "stream, binary stdin" plain_no_predefinition.txt $plain_no_predefinition_rc stream_stdin.txt $?
+
+# server: text and binary protocol give the same responses, messages of --files pass are kept in JSON output
+"$analyzer" $stream_args --server < request.txt > response_text.txt
+grep -q "declared-never-used" response_text.txt || fail "server, text (no messages in response)"
+"$analyzer" $stream_args --server < request.bin > response.bin
+python3 stream_tool.py text response.bin > response_binary.txt
+same_run "server, binary" response_text.txt 0 response_binary.txt 0
+
+"$analyzer" $stream_args --server:server.sock > /dev/null &
+server_pid=$!
+grep -v "###\[EXIT\]" request.txt > request_no_exit.txt
+python3 stream_tool.py send server.sock request_no_exit.txt > socket_response_text.txt
+same_run "server, unix socket, text" response_text.txt 0 socket_response_text.txt 0
+python3 stream_tool.py send server.sock request.bin > socket_response.bin
+same_run "server, unix socket, binary" response.bin 0 socket_response.bin 0
+wait $server_pid
+
+"$analyzer" $args --server --message-output-file:server.json < request.txt > /dev/null
+same_run "server after --files" plain.json 0 server.json 0
+
+# coordinator and workers, files of a worker which hangs are handed out to another worker
+free_port=$(python3 -c 'import socket; s = socket.socket(); s.bind(("127.0.0.1", 0)); print(s.getsockname()[1])')
+"$analyzer" $args --coordinator:$free_port --worker-timeout:1 --verbose > coordinator.txt 2> coordinator_log.txt &
+coordinator_pid=$!
+python3 stream_tool.py hang $free_port > hang_port.txt &
+hang_pid=$!
+for i in $(seq 1 100)
+do
+  [ -s hang_port.txt ] && break
+  sleep 0.1
+done
+"$analyzer" $args --worker:127.0.0.1:$(cat hang_port.txt) > /dev/null 2>&1
+for i in $(seq 1 100)
+do
+  grep -q "is connected" coordinator_log.txt && break
+  sleep 0.1
+done
+"$analyzer" $args --worker:127.0.0.1:$free_port > /dev/null 2>&1
+wait $coordinator_pid
+same_run "coordinator" plain.txt $plain_rc coordinator.txt $?
+grep -q "handed out again" coordinator_log.txt || fail "coordinator (files of hung worker are not handed out again)"
+kill $hang_pid 2> /dev/null
+wait $hang_pid 2> /dev/null
+
+# remote result cache, cold and warm
+python3 "$tests_dir/../drey/result_cache_server.py" --port 0 --dir remote_cache > cache_server.txt 2>&1 &
+cache_server_pid=$!
+for i in $(seq 1 100)
+do
+  grep -q "Serving" cache_server.txt && break
+  sleep 0.1
+done
+cache_port=$(sed -n 's/.*:\([0-9]*\)\/$/\1/p' cache_server.txt)
+if [ -z "$cache_port" ]
+then
+  fail "remote cache (server is not started)"
+else
+  "$analyzer" $args --cache-url:http://127.0.0.1:$cache_port/ > remote_cold.txt
+  same_run "remote cache, cold" plain.txt $plain_rc remote_cold.txt $?
+  "$analyzer" $args --cache-url:http://127.0.0.1:$cache_port/ --verbose > remote_warm.txt 2> remote_warm_stats.txt
+  same_run "remote cache, warm" plain.txt $plain_rc remote_warm.txt $?
+  grep -q "Remote cache: $(wc -l < files.txt) of $(wc -l < files.txt) files found" remote_warm_stats.txt ||
+    fail "remote cache, warm (files are not found in cache)"
+fi
+kill $cache_server_pid
+wait $cache_server_pid 2> /dev/null
+
+fi
+
+
+if [[ $failed == "" ]]
+then
+  echo "OK"
+  exit 0
+else
+  echo "FAIL:$failed"
+  exit 1
+fi
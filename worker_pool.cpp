@@ -0,0 +1,222 @@
+#include "worker_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+void run_ordered_jobs(size_t count, int jobs, const function<void(size_t)> & work, const function<void(size_t)> & done)
+{
+  if (jobs <= 1 || count <= 1)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      work(i);
+      done(i);
+    }
+    return;
+  }
+
+  atomic<size_t> next(0);
+  mutex finishedMutex;
+  condition_variable finishedCv;
+  vector<bool> finished(count, false);
+
+  auto worker = [&]()
+  {
+    for (;;)
+    {
+      size_t i = next++;
+      if (i >= count)
+        return;
+
+      work(i);
+
+      {
+        lock_guard<mutex> lock(finishedMutex);
+        finished[i] = true;
+      }
+      finishedCv.notify_all();
+    }
+  };
+
+  vector<thread> threads;
+  for (int j = 0; j < jobs && j < int(count); j++)
+    threads.push_back(thread(worker));
+
+  for (size_t i = 0; i < count; i++)
+  {
+    {
+      unique_lock<mutex> lock(finishedMutex);
+      finishedCv.wait(lock, [&]() { return bool(finished[i]); });
+    }
+    done(i);
+  }
+
+  for (thread & t : threads)
+    t.join();
+}
+
+
+int hardware_jobs_count()
+{
+  unsigned n = thread::hardware_concurrency();
+  return n > 0 ? int(n) : 1;
+}
+
+
+OrderedJobStream::OrderedJobStream(int jobs_, const function<void(size_t)> & work_, const function<void(size_t)> & done_) :
+  jobs(jobs_), work(work_), done(done_), added(0), next(0), doneCount(0), window(0), closed(false), prepareAhead(0),
+  prepareMemoryLimit(0), preparedCount(0), preparedMemory(0)
+{
+}
+
+
+void OrderedJobStream::setPrepareStage(const function<size_t(size_t)> & prepare_, size_t max_prepared_ahead,
+  size_t max_memory)
+{
+  lock_guard<mutex> lock(streamMutex);
+  prepare = prepare_;
+  prepareAhead = max_prepared_ahead > 0 ? max_prepared_ahead : 1;
+  prepareMemoryLimit = max_memory;
+}
+
+
+size_t OrderedJobStream::itemAt(size_t start_index) const
+{
+  return start_index < startOrder.size() ? startOrder[start_index] : start_index;
+}
+
+
+void OrderedJobStream::setWindow(size_t max_items)
+{
+  lock_guard<mutex> lock(streamMutex);
+  window = max_items;
+}
+
+
+void OrderedJobStream::setStartOrder(const vector<size_t> & order)
+{
+  lock_guard<mutex> lock(streamMutex);
+  startOrder = order;
+}
+
+
+void OrderedJobStream::add()
+{
+  {
+    lock_guard<mutex> lock(streamMutex);
+    added++;
+    finished.push_back(false);
+    itemMemory.push_back(0);
+  }
+  streamCv.notify_all();
+}
+
+
+void OrderedJobStream::close()
+{
+  {
+    lock_guard<mutex> lock(streamMutex);
+    closed = true;
+  }
+  streamCv.notify_all();
+}
+
+
+void OrderedJobStream::workerLoop()
+{
+  for (;;)
+  {
+    size_t i = 0;
+    {
+      unique_lock<mutex> lock(streamMutex);
+      streamCv.wait(lock, [&]()
+      {
+        return (next < added && (!window || next < doneCount + window) && (!prepare || next < preparedCount)) ||
+          (closed && next >= added);
+      });
+      if (next >= added)
+        return;
+      i = itemAt(next);
+      next++;
+    }
+
+    work(i);
+
+    {
+      lock_guard<mutex> lock(streamMutex);
+      finished[i] = true;
+      preparedMemory -= itemMemory[i];
+      itemMemory[i] = 0;
+    }
+    streamCv.notify_all();
+  }
+}
+
+
+void OrderedJobStream::prepareLoop()
+{
+  for (size_t k = 0;; k++)
+  {
+    size_t i = 0;
+    {
+      unique_lock<mutex> lock(streamMutex);
+      streamCv.wait(lock, [&]()
+      {
+        return (k < added && k < next + prepareAhead && (!prepareMemoryLimit || !preparedMemory ||
+          preparedMemory < prepareMemoryLimit)) || (closed && k >= added);
+      });
+      if (k >= added)
+        return;
+      i = itemAt(k);
+    }
+
+    size_t memory = prepare(i);
+
+    {
+      lock_guard<mutex> lock(streamMutex);
+      preparedCount = k + 1;
+      itemMemory[i] = memory;
+      preparedMemory += memory;
+    }
+    streamCv.notify_all();
+  }
+}
+
+
+void OrderedJobStream::run()
+{
+  // a single worker still runs apart from done(), so output of finished items overlaps work on the next ones
+  vector<thread> threads;
+  for (int j = 0; j < jobs || j < 1; j++)
+    threads.push_back(thread([this]() { workerLoop(); }));
+
+  if (prepare)
+    threads.push_back(thread([this]() { prepareLoop(); }));
+
+  for (size_t i = 0;; i++)
+  {
+    {
+      unique_lock<mutex> lock(streamMutex);
+      streamCv.wait(lock, [&]() { return (i < added && finished[i]) || (closed && i >= added); });
+      if (i >= added)
+        break;
+    }
+
+    done(i);
+
+    {
+      lock_guard<mutex> lock(streamMutex);
+      doneCount = i + 1;
+    }
+    streamCv.notify_all();
+  }
+
+  for (thread & t : threads)
+    t.join();
+}
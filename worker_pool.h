@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <stddef.h>
+
+
+// Runs work(i) for each i in [0, count) on 'jobs' threads. done(i) is called on the calling thread
+// in ascending order of i, as soon as item i and all items before it are finished.
+void run_ordered_jobs(size_t count, int jobs, const std::function<void(size_t)> & work,
+  const std::function<void(size_t)> & done);
+
+int hardware_jobs_count();
+
+
+// Ordered processing of items which are added while the processing is already running.
+// Stages: optional prepare(i) on its own thread (e.g. reading of input), work(i) on 'jobs' threads,
+// done(i) on the thread of run() in the order of adding. Stages are connected by bounded queues.
+class OrderedJobStream
+{
+  int jobs;
+  std::function<void(size_t)> work;
+  std::function<void(size_t)> done;
+  std::function<size_t(size_t)> prepare; // returns memory held by the item until its work() is finished
+
+  std::mutex streamMutex;
+  std::condition_variable streamCv;
+  size_t added;
+  size_t next;
+  size_t doneCount;
+  size_t window; // 0 - unlimited
+  bool closed;
+  std::vector<bool> finished;
+  std::vector<size_t> startOrder;
+  size_t prepareAhead; // at most this number of prepared items wait for work()
+  size_t prepareMemoryLimit; // 0 - unlimited
+  size_t preparedCount; // in the start order
+  size_t preparedMemory; // held by prepared items which are not finished yet
+  std::vector<size_t> itemMemory;
+
+  size_t itemAt(size_t start_index) const;
+  void workerLoop();
+  void prepareLoop();
+
+public:
+  OrderedJobStream(int jobs, const std::function<void(size_t)> & work, const std::function<void(size_t)> & done);
+  void add(); // can be called from any thread
+  void close(); // no items will be added after this call
+  void setWindow(size_t max_items); // at most max_items are started ahead of the last done() item
+  // already added items are started in this order (permutation of their indices), done() order is not changed
+  void setStartOrder(const std::vector<size_t> & order);
+  // prepare(i) is called before work(i) on a separate thread, in the start order. Next item is not prepared
+  // while memory of unfinished prepared items is over max_memory (0 - unlimited), except when there are none.
+  void setPrepareStage(const std::function<size_t(size_t)> & prepare_, size_t max_prepared_ahead, size_t max_memory);
+  void run(); // returns when stream is closed and all items are done, work() never runs on this thread
+};